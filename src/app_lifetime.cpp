@@ -20,6 +20,8 @@
 #include "app_lifetime.h"
 #include "protocol.hpp"
 
+using namespace std::string_view_literals;
+
 #ifdef VIOLET_SOCKET_USE_OPENSSL	/// hmm... should probably switch to GNUTLS instead
 void init_openssl()
 { 
@@ -91,31 +93,40 @@ void ConsoleHandlerRoutine(int sig)
 	std::exit(EXIT_SUCCESS);
 }
 
-template<class Map>
-void ComposeMIMEs(Map & ct, const char * fn) {
+/*
+	One type per line: "ext mime [compress|store]".
+	Types are built in, the file only needs what is missing or different.
+	The optional class overrides whatever the policy would guess from the MIME type.
+*/
+void ComposeMIMEs(mime_table & ct, compression_policy & policy, const char * fn) {
 	Violet::UniBuffer f;
 	f.read_from_file(fn);
-	std::string keyword;
-	while (!f.is_at_end()) {
-		size_t p1 = f.get_pos(), p2, len = f.length();
-		char * c = reinterpret_cast<char*>(f.data());
-		for (p2 = p1; p2 < len; ++p2)
-			if (c[p2] == 0x20 || c[p2] == 0x0d)
+	std::string_view text = f.get_string();
+	while (!text.empty()) {
+		std::string_view line = text.substr(0, text.find('\n'));
+		text.remove_prefix(std::min(line.size() + 1, text.size()));
+		std::string_view token[3];
+		size_t n = 0;
+		while (n < 3) {
+			while (!line.empty() && (line.front() == 0x20 || line.front() == '\t' || line.front() == 0x0d))
+				line.remove_prefix(1);
+			if (line.empty())
 				break;
-		std::string s{ c + p1, c + p2 };
-
-		// I guess, why not???
-		s.shrink_to_fit();
-
-		if (c[p2] == 0x20) {
-			keyword = std::move(s);
-			f.set_pos(p2 + 1);
+			const auto e = line.find_first_of(" \t\r"sv);
+			token[n++] = line.substr(0, e);
+			line.remove_prefix(std::min(e, line.size()));
 		}
-		else {
-			ct.emplace(std::move(keyword), std::move(s));
-			f.set_pos(p2 + 2);
+		if (n < 2)
+			continue;
+		if (n == 3) {
+			if (token[2] == "compress"sv)
+				policy.classify(token[1], true);
+			else if (token[2] == "store"sv)
+				policy.classify(token[1], false);
 		}
+		ct.set(token[0], token[1]);
 	}
+	ct.commit();
 }
 
 void RoutineA(std::pair<const Application::Server&, Violet::ListeningSocket> &l
@@ -127,7 +138,9 @@ void RoutineA(std::pair<const Application::Server&, Violet::ListeningSocket> &l
 	Protocol::Shared shared_registry {
 		l.first.dir.size() ? l.first.dir.c_str() : nullptr,
 		l.first.dir_meta.size() ? l.first.dir_meta.c_str() : nullptr,
-		l.first.copyright
+		l.first.copyright,
+		l.first.max_body,
+		l.first.body_limits
 	};
 	unsigned int tick = 0;
 	bool block = true;
@@ -158,6 +171,8 @@ void RoutineA(std::pair<const Application::Server&, Violet::ListeningSocket> &l
 #endif
 		}
 
+		shared_registry.files.poll();
+
 		if (!!http.size())
 		{
 			for (auto &it : http)
@@ -280,7 +295,7 @@ int ApplicationLifetime(const Application &app)
 	std::signal(SIGINT, ConsoleHandlerRoutine);
 	std::signal(SIGTERM, ConsoleHandlerRoutine);
 	
-	ComposeMIMEs(Protocol::content_types, "content_types.txt");
+	ComposeMIMEs(Protocol::mime_types, Protocol::compression, "content_types.txt");
 
 	if (ls.size() == 1) { // no need for threads if there's just one.
 #ifdef VIOLET_SOCKET_USE_OPENSSL
@@ -346,6 +361,26 @@ Str & remove_last_char(Str & str, const typename Str::value_type c) {
 	return str;
 }
 
+/* "4096", "512k", "64M" or "1G", returns false on garbage */
+bool parse_size(std::string_view v, size_t & out)
+{
+	Violet::remove_prefix_whitespace(v);
+	Violet::remove_suffix_whitespace(v);
+	const auto left = Violet::svtonum(v, out, 10);
+	if (left == static_cast<ptrdiff_t>(v.size()))
+		return false;
+	if (left == 0)
+		return true;
+	if (left > 1)
+		return false;
+	switch (std::tolower(static_cast<unsigned char>(v.back()))) {
+		case 'k': out <<= 10; return true;
+		case 'm': out <<= 20; return true;
+		case 'g': out <<= 30; return true;
+		default: return false;
+	}
+}
+
 void Application::CheckConfigFile(const char *filename) {
 	std::string __src;
 	if (Violet::internal::read_from_file(filename, __src)) {
@@ -422,6 +457,33 @@ void Application::CheckConfigFile(const char *filename) {
 			else if (tags[0] == "CopyrightNotice") {
 				stack.back().copyright.assign(tags[2]);
 			}
+			else if (tags[0] == "MaxBodySize") {
+				// either a bare size (server default) or "/route size"
+				std::string_view val = tags[2], route;
+				if (!!val.size() && val.front() == '/') {
+					const auto sp = val.find(' ');
+					route = val.substr(0, sp);
+					val = sp != std::string_view::npos ? val.substr(sp + 1) : std::string_view{};
+				}
+				size_t size;
+				if (!parse_size(val, size)) {
+					puts("ERROR: Value assigned to \'MaxBodySize\' must be a size, optionally preceded by a route");
+					std::exit(EXIT_FAILURE);
+				}
+				if (route.size())
+					stack.back().body_limits.insert_or_assign(std::string{ route }, size);
+				else
+					stack.back().max_body = size;
+			}
+			else if (tags[0] == "ParallelDeflateThreshold" || tags[0] == "ParallelDeflateBlock") {
+				// process-wide, the compression pool is shared by all servers
+				size_t size;
+				if (!parse_size(tags[2], size)) {
+					printf("ERROR: Value assigned to \'%.*s\' must be a size\n", static_cast<int>(tags[0].size()), tags[0].data());
+					std::exit(EXIT_FAILURE);
+				}
+				(tags[0] == "ParallelDeflateBlock" ? Protocol::compression.parallel_block : Protocol::compression.parallel_threshold) = size;
+			}
 			else if (tags[0] == "SSL") {
 #ifndef VIOLET_SOCKET_USE_OPENSSL
 				puts("WARNING: Application has been built without SSL support");
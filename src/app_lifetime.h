@@ -22,12 +22,16 @@
 
 #define DIRECTORY_SHARED "shared"
 
+#define DEFAULT_MAX_BODY_SIZE (1 << 20)
+
 struct Application {
 
 	struct Server {
 		uint16_t port;
 		bool ssl = false;
 		std::string dir, dir_meta, copyright;
+		size_t max_body = DEFAULT_MAX_BODY_SIZE;
+		std::map<std::string, size_t, std::less<>> body_limits;	// per route
 		Server(uint16_t _p) : port(_p) {}
 	};
 	std::list<Server> stack;
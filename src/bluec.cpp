@@ -0,0 +1,190 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "bluescript.hpp"
+#include "echo/hash.hpp"
+#include <cinttypes>
+
+/*
+	bluec output.cpp root template...
+	Writes Blue::find_compiled() with a render function for each template (given relative to root,
+	as the server opens them). Literals and arguments end up as string literals, the instructions as code.
+*/
+
+using namespace std::string_view_literals;
+
+namespace
+{
+	const char * const function_names[] = { "Unknown", "Constant", "Variable", "Wrapper", "Title", "Content", "BlogLoad", "Posts", "StatusErrorCode",
+		"StatusErrorText", "Copyright", "Bitcoin", "Battery", "Include", "StartSession", "KillSession", "Register", "SessionInfo", "Echo", "GenerateCaptcha", "Catch_recv_error" };
+	const char * const operator_names[] = { "none", "equality", "lessthan", "greaterthan" };
+
+	std::string quoted(std::string_view s, std::string_view suffix = "sv"sv)
+	{
+		std::string q{ "\"" };
+		size_t line = 0;
+		for (const unsigned char c : s) {
+			if (q.size() - line > 120) {
+				q += "\"\n\t\t\"";
+				line = q.size();
+			}
+			if (c == '"' || c == '\\')
+				(q += '\\') += c;
+			else if (c == '\n')
+				q += "\\n";
+			else if (c >= 0x20 && c < 0x7f && c != '?')
+				q += c;
+			else {
+				char oct[8];
+				snprintf(oct, sizeof(oct), "\\%03o", c);
+				q += oct;
+			}
+		}
+		return (q += '"') += suffix;
+	}
+
+	struct generator
+	{
+		std::string decls, code;
+		unsigned functions = 0, blocks = 0, loops = 0, programs = 0;
+
+		std::string function(const Blue::HeartFunction &hf) {
+			std::string e{ "fn(Blue::Function::" };
+			e += function_names[static_cast<size_t>(hf.key)];
+			e += ", {";
+			for (size_t i = 0; i < hf.arg.size(); ++i)
+				(e += i ? ", " : " ") += quoted(hf.arg[i]);
+			e += hf.arg.empty() ? "}" : " }";
+			if (bool(hf.chain))
+				(e += ", std::make_unique<Blue::HeartFunction>(") += function(*hf.chain) += ')';
+			return e += ')';
+		}
+
+		std::string block(const Blue::TangerineBlock &tb) {
+			const auto name = "t" + std::to_string(blocks++);
+			decls += "\tconst Blue::TangerineBlock " + name + " = tb(" + quoted(tb.name) + ", " + quoted(tb.sub) + ", " + quoted(tb.content)
+				+ ", Blue::Operator::" + operator_names[static_cast<size_t>(tb.op)] + ", ";
+			if (auto l = std::get_if<long>(&tb.comp_val))
+				decls += std::to_string(*l) + "L);\n";
+			else
+				decls += quoted(std::get<std::string_view>(tb.comp_val)) + ");\n";
+			return name;
+		}
+
+		std::string rows(const Blue::CherryBlock &cb) {
+			const auto name = "c" + std::to_string(loops++);
+			decls += "\tconst Blue::CherryBlock " + name + " = ch(" + quoted(cb.name) + ", " + quoted(cb.source) + ", " + quoted(cb.content)
+				+ ", " + quoted(cb.empty) + ");\n";
+			return name;
+		}
+
+		// nested bodies are emitted first, a program only refers to what's already declared
+		std::string program(const Blue::Program &prog) {
+			std::string body;
+			for (size_t ip = 0; ip < prog.code.size(); ++ip) {
+				body += "\tcase " + std::to_string(ip) + ":\n\t\t";
+				std::visit([&](const auto &i) {
+					using T = std::decay_t<decltype(i)>;
+					if constexpr (std::is_same_v<T, std::string_view>)
+						body += "rt.text(" + quoted(i) + ");\n";
+					else if constexpr (std::is_same_v<T, Blue::StrategicEscape>)
+						body += "rt.escape(" + std::to_string(i.val) + ");\n";
+					else if constexpr (std::is_same_v<T, Blue::ParseError>)
+						body += "rt.fail(" + quoted(i.what, {}) + ");\n";
+					else if constexpr (std::is_same_v<T, Blue::Branch>) {
+						const auto test = block(i.test), then = program(*i.then);
+						const auto otherwise = bool(i.otherwise) ? program(*i.otherwise) : std::string{ "nullptr" };
+						body += "rt.branch(" + test + ", " + then + ", " + otherwise + ");\n";
+					}
+					else if constexpr (std::is_same_v<T, Blue::Loop>) {
+						const auto rows_of = rows(i.rows), each = program(*i.body);
+						const auto otherwise = bool(i.otherwise) ? program(*i.otherwise) : std::string{ "nullptr" };
+						body += "rt.loop(" + rows_of + ", " + each + ", " + otherwise + ");\n";
+					}
+					else {
+						const auto name = "f" + std::to_string(functions++);
+						decls += "\tconst Blue::HeartFunction " + name + " = " + function(i) + ";\n";
+						body += "if (rt.call(" + name + ", &@, " + std::to_string(ip + 1) + "))\n\t\t\treturn;\n";
+					}
+				}, prog.code[ip]);
+				body += "\t\t[[fallthrough]];\n";
+			}
+			const auto name = "p" + std::to_string(programs++);
+			for (size_t at; (at = body.find('@')) != std::string::npos;)
+				body.replace(at, 1, name);
+			code += "\nvoid " + name + "(Blue::Runtime &rt, size_t ip)\n{\n\tswitch (ip)\n\t{\n" + body + "\tdefault:\n\t\tbreak;\n\t}\n}\n";
+			return name;
+		}
+	};
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		puts("Usage: bluec output.cpp root [template...]");
+		return EXIT_FAILURE;
+	}
+	generator gen;
+	std::string table;
+	std::vector<std::string> texts;	// the programs point into these
+	for (int i = 3; i < argc; ++i) {
+		Violet::UniBuffer file;
+		if (!file.read_from_file((std::string(argv[2]) + '/' + argv[i]).c_str())) {
+			printf("bluec: can't read %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		const auto &text = texts.emplace_back(file.get_string());
+		bool is_template;
+		const auto prog = Blue::compile_file(text, is_template);
+		char hash[24];
+		snprintf(hash, sizeof(hash), "0x%016" PRIx64, Violet::xxh64(text.data(), text.size()));
+		table += "\t\t{ " + quoted(argv[i]) + ", " + hash + "u, " + gen.program(*prog) + " },\n";
+	}
+
+	std::string out{ "// Generated by bluec from the templates below, don't edit\n\n#include \"pch.h\"\n#include \"bluescript.hpp\"\n\n"
+		"using namespace std::string_view_literals;\n\nnamespace\n{\n"
+		"\t[[maybe_unused]] Blue::HeartFunction fn(Blue::Function key, std::vector<std::string_view> arg, std::unique_ptr<Blue::HeartFunction> chain = nullptr)\n\t{\n"
+		"\t\tBlue::HeartFunction f{ key };\n\t\tf.arg = std::move(arg);\n\t\tf.chain = std::move(chain);\n\t\tBlue::resolve(f);\n\t\treturn f;\n\t}\n\n"
+		"\t[[maybe_unused]] Blue::TangerineBlock tb(std::string_view name, std::string_view sub, std::string_view content, Blue::Operator op, std::variant<long, std::string_view> val)\n\t{\n"
+		"\t\tBlue::TangerineBlock t;\n\t\tt.name = name;\n\t\tt.sub = sub;\n\t\tt.content = content;\n\t\tt.op = op;\n\t\tt.comp_val = val;\n\t\tBlue::resolve(t);\n\t\treturn t;\n\t}\n\n"
+		"\t[[maybe_unused]] Blue::CherryBlock ch(std::string_view name, std::string_view source, std::string_view content, std::string_view empty)\n\t{\n"
+		"\t\tBlue::CherryBlock c;\n\t\tc.name = name;\n\t\tc.source = source;\n\t\tc.content = content;\n\t\tc.empty = empty;\n\t\tBlue::resolve(c);\n\t\treturn c;\n\t}\n\n" };
+	out += gen.decls;
+	out += gen.code;
+	out += "}\n\nBlue::Render Blue::find_compiled(std::string_view path, uint64_t hash)\n{\n";
+	if (table.empty())
+		out += "\treturn nullptr;\n}\n";
+	else {
+		out += "\tstatic const struct { std::string_view path; uint64_t hash; Render render; } compiled[] = {\n" + table + "\t};\n";
+		out += "\tfor (const auto &c : compiled)\n\t\tif (c.path == path && c.hash == hash)\n\t\t\treturn c.render;\n\treturn nullptr;\n}\n";
+	}
+
+	// only touched when something changed, or everything depending on it is rebuilt
+	Violet::UniBuffer old;
+	if (old.read_from_file(argv[1]) && old.get_string() == out)
+		return EXIT_SUCCESS;
+	if (FILE * f = fopen(argv[1], "wb")) {
+		fwrite(out.data(), 1, out.size(), f);
+		fclose(f);
+		return EXIT_SUCCESS;
+	}
+	printf("bluec: can't write %s\n", argv[1]);
+	return EXIT_FAILURE;
+}
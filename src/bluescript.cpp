@@ -49,6 +49,15 @@ const std::unordered_map <unsigned int, Function> super_sweets {
 	{ Codepoints::IceCream, Function::Constant }
 };
 
+const std::array<unsigned, 6> markers{	// Beware of U+FE0F after some emojis
+	Codepoints::SuitHeart,
+	Codepoints::RedHeart,
+	Codepoints::Tangerine,
+	Codepoints::Cherries,
+	Codepoints::Ghost,
+	Codepoints::CrossMark
+};
+
 const std::unordered_map <std::string_view, Operator> ops {
 	{ "==", Operator::equality },
 	{ "=", Operator::equality },
@@ -173,6 +182,93 @@ void print_tags_2(std::FILE* stream, const std::vector<Str> &v) {
 	fprintf(stream, "\n");
 }
 
+Symbol Blue::intern(std::string_view name)
+{
+	static std::mutex lock;
+	static std::unordered_map<std::string, Symbol> symbols;
+	std::lock_guard<std::mutex> guard(lock);
+	return symbols.try_emplace(std::string(name), static_cast<Symbol>(symbols.size())).first->second;
+}
+
+static Lookup lookup(std::string_view list)
+{
+	if (list == "get"sv)
+		return Lookup::get;
+	else if (list == "post"sv)
+		return Lookup::post;
+	else if (list == "cookie"sv)
+		return Lookup::cookie;
+	return Lookup::row;
+}
+
+static Symbol column(std::string_view name, std::string_view col)
+{
+	std::string s{ name };
+	((s += '[') += col) += ']';
+	return intern(s);
+}
+
+void Blue::resolve(HeartFunction &hf)
+{
+	switch (hf.key)
+	{
+	case Function::Echo:
+		if (hf.arg.size() == 2) {
+			hf.from = lookup(hf.arg[0]);
+			hf.var = column(hf.arg[0], hf.arg[1]);	// a loop by that name goes first
+			break;
+		}
+		[[fallthrough]];
+	case Function::Constant:
+	case Function::StartSession:
+	case Function::Register:
+		if (!hf.arg.empty())
+			hf.var = intern(hf.arg[0]);
+		break;
+	default:
+		break;
+	}
+}
+
+void Blue::resolve(TangerineBlock &tb)
+{
+	if (!tb.sub.empty()) {
+		tb.from = lookup(tb.name);
+		tb.var = column(tb.name, tb.sub);	// a loop by that name goes first
+	}
+	else if (tb.name == "Session"sv)
+		tb.from = Lookup::session;
+	else if (tb.name == "NoSession"sv)
+		tb.from = Lookup::no_session;
+	else if (tb.name == "Userlevel"sv)
+		tb.from = Lookup::userlevel;
+	else {
+		tb.from = Lookup::variable;
+		tb.var = intern(tb.name);
+	}
+}
+
+void Blue::resolve(CherryBlock &cb)
+{
+	static const std::unordered_map<std::string_view, std::pair<Rows, std::vector<std::string_view>>> sources {
+		{ "posts", { Rows::posts, { "title", "content", "date", "blog" } } },
+		{ "tags", { Rows::tags, {} } },
+		{ "get", { Rows::get, { "key", "value" } } },
+		{ "post", { Rows::post, { "key", "value" } } },
+		{ "cookie", { Rows::cookie, { "key", "value" } } },
+		{ "session", { Rows::session, { "username", "userlevel" } } }
+	};
+	cb.columns.clear();
+	if (const auto s = sources.find(cb.source); s != sources.end()) {
+		cb.rows = s->second.first;
+		if (s->second.second.empty())
+			cb.columns.emplace_back(intern(cb.name));
+		for (const auto col : s->second.second)
+			cb.columns.emplace_back(column(cb.name, col));
+	}
+	else cb.rows = Rows::unknown;
+}
+
 HeartFunction parse_function(Violet::utf8x::translator<char> &uc) {
 	Violet::utf8x::translator<char> uc_copy{ uc };
 	uc_copy.skip_whitespace();
@@ -199,6 +295,7 @@ HeartFunction parse_function(Violet::utf8x::translator<char> &uc) {
 				if (auto chf = parse_function(uc); chf.key != Function::Unknown)
 					hf.chain = std::make_unique<HeartFunction>(std::move(chf));
 			}
+			resolve(hf);
 			return hf;
 		}
 	}
@@ -241,6 +338,7 @@ std::optional<TangerineBlock> parse_block(Violet::utf8x::translator<char> &uc)
 	}
 	else if (tags.size() != 1 + shift)
 		return {};
+	resolve(tb);
 	tb.content = find_a_proper_watermelon(uc);
 	while (*uc == 0xfe0f)
 		++uc;
@@ -263,10 +361,46 @@ std::optional<TangerineBlock> parse_block(Violet::utf8x::translator<char> &uc)
 	return tb;
 }
 
+std::optional<CherryBlock> parse_loop(Violet::utf8x::translator<char> &uc)
+{
+	uc.skip_whitespace();
+	std::string_view str = uc.pop_substr_until([](unsigned c) { return c == Codepoints::Grape; });
+	if (!str.size() || uc.is_at_end())
+		return {};
+	++uc;
+	Violet::remove_suffix_whitespace(str);
+
+	const auto tags = split(str);
+	if (tags.size() != 3 || tags[1] != ":")
+		return {};
+
+	CherryBlock cb;
+	cb.name = tags[0];
+	cb.source = tags[2];
+	resolve(cb);
+	if (cb.rows == Rows::unknown)
+		return {};
+	cb.content = find_a_proper_watermelon(uc);
+	while (*uc == 0xfe0f)
+		++uc;
+
+	const auto _s = uc.get_pos();
+	uc.skip_whitespace();
+	if (*uc == Codepoints::Strawberry) {
+		(++uc).skip_whitespace();
+		if (*uc == Codepoints::Grape) {
+			cb.empty = find_a_proper_watermelon(++uc);
+			return cb;
+		}
+	}
+	uc.set_pos(_s);
+	return cb;
+}
+
 std::string_view Blue::find_a_proper_watermelon(Violet::utf8x::translator<char>& src) {
 	unsigned inner_block_count = 0;
 	const size_t start = src.get_pos();
-	const std::array<Blue::Codepoints, 4> tasty_fruits { Blue::Codepoints::Ghost, Blue::Codepoints::Tangerine, Blue::Codepoints::Watermelon, Blue::Codepoints::CrossMark };
+	const std::array<Blue::Codepoints, 5> tasty_fruits { Blue::Codepoints::Ghost, Blue::Codepoints::Tangerine, Blue::Codepoints::Cherries, Blue::Codepoints::Watermelon, Blue::Codepoints::CrossMark };
 	while (!src.is_at_end()) {
 		src.find_and_iterate_array(tasty_fruits);
 		switch (src) {
@@ -288,6 +422,7 @@ std::string_view Blue::find_a_proper_watermelon(Violet::utf8x::translator<char>&
 			++src;
 			break;
 		case Blue::Codepoints::Tangerine:
+		case Blue::Codepoints::Cherries:
 			src.find_and_iterate(Blue::Codepoints::Grape);
 			++inner_block_count;
 			++src;
@@ -326,6 +461,11 @@ Candy Blue::parse(Violet::utf8x::translator<char> &uc)
 		if (auto tb = parse_block(uc))
 			return std::move(*tb);
 		break;
+
+	case Codepoints::Cherries:
+		if (auto cb = parse_loop(uc))
+			return std::move(*cb);
+		break;
 	
 	case Codepoints::RedHeart:	// generic function structure
 	case Codepoints::SuitHeart:
@@ -337,4 +477,75 @@ Candy Blue::parse(Violet::utf8x::translator<char> &uc)
 		return StrategicEscape{ uc++ };
 	}
 	return bool(true);
-}
\ No newline at end of file
+}
+
+static Loop compile_loop(CherryBlock &&cb)
+{
+	Loop lp;
+	lp.body = std::make_unique<const Program>(compile(cb.content));
+	if (!cb.empty.empty())
+		lp.otherwise = std::make_unique<const Program>(compile(cb.empty));
+	lp.rows = std::move(cb);
+	return lp;
+}
+
+static Branch compile_block(TangerineBlock &&tb)
+{
+	Branch br;
+	br.then = std::make_unique<const Program>(compile(tb.content));
+	if (bool(tb.elseblock)) {
+		if (auto strawberry = std::get_if<std::string_view>(tb.elseblock.get())) {
+			br.otherwise = std::make_unique<const Program>(compile(*strawberry));
+		}
+		else if (auto lemon = std::get_if<TangerineBlock>(tb.elseblock.get())) {
+			auto p = std::make_unique<Program>();
+			p->code.emplace_back(compile_block(std::move(*lemon)));
+			br.otherwise = std::move(p);
+		}
+		tb.elseblock.reset();
+	}
+	br.test = std::move(tb);
+	return br;
+}
+
+Program Blue::compile(Violet::utf8x::translator<char> uc)
+{
+	Program p;
+	size_t read_pos = uc.get_pos(), pos;
+	try {
+		while ((pos = uc.find_and_iterate_array(markers)) < uc.size()) {
+			auto candy = parse(uc);
+			if (auto keep_body = std::get_if<bool>(&candy); keep_body && *keep_body)
+				continue;	// not a construct after all, the marker stays in the text
+			if (pos > read_pos)
+				p.code.emplace_back(std::in_place_type<std::string_view>, uc.substr(read_pos, pos - read_pos));
+			read_pos = uc.get_pos();
+			std::visit([&p](auto &&c) {
+				using value_type = std::decay_t<decltype(c)>;
+				if constexpr (std::is_same_v<value_type, TangerineBlock>)
+					p.code.emplace_back(compile_block(std::move(c)));
+				else if constexpr (std::is_same_v<value_type, CherryBlock>)
+					p.code.emplace_back(compile_loop(std::move(c)));
+				else if constexpr (!std::is_same_v<value_type, bool>)
+					p.code.emplace_back(std::move(c));
+			}, std::move(candy));
+		}
+		if (uc.size() > read_pos)
+			p.code.emplace_back(std::in_place_type<std::string_view>, uc.substr(read_pos));
+	}
+	catch (std::exception &e) {
+		// text preceding the broken construct is dropped, as it always was
+		p.code.emplace_back(ParseError{ e.what() });
+	}
+	p.code.shrink_to_fit();
+	return p;
+}
+
+std::unique_ptr<const Program> Blue::compile_file(std::string_view text, bool &is_template)
+{
+	Violet::utf8x::translator<char> uc{ text };
+	uc.skip_whitespace();
+	if ((is_template = *uc == Codepoints::ChequeredFlag))
+		++uc;
+	return std::make_unique<const Program>(compile(std::move(uc)));
+}
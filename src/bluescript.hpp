@@ -19,6 +19,7 @@
 
 #pragma once
 #include "echo/buffers.hpp"
+#include <deque>
 #include <variant>
 
 namespace Blue
@@ -39,36 +40,99 @@ namespace Blue
 		WrappedGift = 0x1F381,
 		Scroll = 0x1F4DC,
 		GrinningFace = 0x1F600,
+		Cherries = 0x1F352,
 		ChequeredFlag = 0x1F3C1
 	};
 	enum class Operator { none, equality, lessthan, greaterthan };
 
+	/*
+		Template variables are interned to small ids, a render keeps their values in a flat array.
+		Ids live as long as the process and are shared by every thread.
+	*/
+	using Symbol = uint32_t;
+	Symbol intern(std::string_view name);
+
+	/* What a name is looked up in, decided when it's parsed */
+	enum class Lookup : uint8_t { variable, get, post, cookie, row, session, no_session, userlevel };
+
 	enum class Function { Unknown, Constant, Variable, Wrapper, Title, Content, BlogLoad, Posts, StatusErrorCode, StatusErrorText, Copyright, Bitcoin, Battery, Include, StartSession, KillSession, Register, SessionInfo, Echo, GenerateCaptcha, Catch_recv_error };
 
 	struct TangerineBlock {
 		std::string_view name, sub, content;
 		Operator op = Operator::none;
 		std::variant<long, std::string_view> comp_val;
+		Lookup from = Lookup::variable;	// the list, when there's a sub
+		Symbol var = 0;	// the variable, or name[sub] of a row, which wins over a request list of the same name
 
 		using else_t = std::variant<std::string_view, TangerineBlock>;
 		std::unique_ptr<else_t> elseblock;
 	};
 
+	/* Collections kept in memory that a cherry block can go over, a row at a time */
+	enum class Rows : uint8_t { unknown, posts, tags, get, post, cookie, session };
+
+	/*
+		Repeats its content for each row, its columns read like request fields (echo name column, name[column]),
+		tags are single values and read as the variable name. The strawberry block renders when there were none.
+	*/
+	struct CherryBlock {
+		std::string_view name, source, content, empty;
+		Rows rows = Rows::unknown;
+		std::vector<Symbol> columns;	// in the order the rows give them
+	};
+
 	struct HeartFunction {
 		const Function key;
 		std::vector<std::string_view> arg;
 		std::unique_ptr<HeartFunction> chain;
+		Lookup from = Lookup::variable;	// echo of a request field or a column
+		Symbol var = 0;	// echo, constant and the name given by sessions, name[column] for rows
 
 		HeartFunction(Function _k) : key(_k) {}
 	};
 
+	/* Sets the ids and lookups from the names, not those of the chain. Parse does it, anything built by hand has to */
+	void resolve(HeartFunction &hf);
+	void resolve(TangerineBlock &tb);
+	void resolve(CherryBlock &cb);
+
 	struct StrategicEscape {
 		unsigned int val;
 
 		StrategicEscape(unsigned int _v) : val(_v) {}
 	};
 
-	using Candy = std::variant<bool, HeartFunction, TangerineBlock, StrategicEscape>;
+	using Candy = std::variant<bool, HeartFunction, TangerineBlock, CherryBlock, StrategicEscape>;
+
+	/*
+		A template parsed once and rendered by walking the instructions in order.
+		Literal spans and arguments point into the source, which has to outlive the program.
+	*/
+	struct Program;
+
+	struct Branch {
+		TangerineBlock test;	// only the condition, both bodies are compiled
+		std::unique_ptr<const Program> then, otherwise;
+	};
+
+	struct Loop {
+		CherryBlock rows;	// the bodies are compiled once and run for every row
+		std::unique_ptr<const Program> body, otherwise;
+	};
+
+	struct ParseError {
+		std::string what;	// raised when rendering gets this far, like the interpreter did
+	};
+
+	using Instruction = std::variant<std::string_view, HeartFunction, StrategicEscape, Branch, Loop, ParseError>;
+
+	struct Program {
+		std::vector<Instruction> code;
+
+		// only partially evaluated programs own anything, text made up while folding and the files it came from
+		std::deque<std::string> text;
+		std::vector<std::shared_ptr<const void>> sources;
+	};
 
 	template<typename A>
 	static inline bool is_operator(const A c) {
@@ -84,6 +148,38 @@ namespace Blue
 	std::string_view find_a_proper_watermelon(Violet::utf8x::translator<char>& src);
 
 	Candy parse(Violet::utf8x::translator<char> &_uc);
+
+	Program compile(Violet::utf8x::translator<char> _uc);
+
+	/*
+		Templates compiled to C++ ahead of time (bluec) render through this, the interpreter implements it.
+		Every program becomes a function that can resume at any instruction, ip counts like Program::code.
+	*/
+	struct Runtime;
+	using Render = void (*)(Runtime &rt, size_t ip);
+
+	struct Runtime {
+		virtual void text(std::string_view t) = 0;	// static storage
+		virtual void escape(unsigned int val) = 0;
+		virtual void fail(const char * what) = 0;
+		virtual void branch(const TangerineBlock &test, Render then, Render otherwise) = 0;
+		virtual void loop(const CherryBlock &rows, Render body, Render otherwise) = 0;
+
+		/* True if a wrapper took the rest of the program, which starts at next */
+		virtual bool call(const HeartFunction &hf, Render self, size_t next) = 0;
+
+	protected:
+		~Runtime() = default;
+	};
+
+	/* Generated by the build, only if the file still hashes (xxh64) to what was compiled */
+	Render find_compiled(std::string_view path, uint64_t hash);
+
+	/*
+		Html files are compiled whole when they're loaded. Pages and includes are templates only
+		when they open with the chequered flag and then start right after it, wrappers don't need one.
+	*/
+	std::unique_ptr<const Program> compile_file(std::string_view text, bool &is_template);
 }
 
 //bool cik_strcmp(const char * s, const char * k);
\ No newline at end of file
@@ -0,0 +1,132 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "compression.hpp"
+#include "echo/parallel_deflate.hpp"
+#include <cmath>
+
+using namespace std::string_view_literals;
+
+namespace
+{
+	// "text/html; charset=utf-8" -> "text/html"
+	std::string_view essence(std::string_view mime)
+	{
+		mime = mime.substr(0, mime.find(';'));
+		while (!mime.empty() && mime.back() == ' ')
+			mime.remove_suffix(1);
+		return mime;
+	}
+
+	bool ends_with(std::string_view s, std::string_view suffix)
+	{
+		return s.size() >= suffix.size() && s.substr(s.size() - suffix.size()) == suffix;
+	}
+
+	bool guess(std::string_view mime)
+	{
+		if (mime.substr(0, 5) == "text/"sv || ends_with(mime, "+xml"sv) || ends_with(mime, "+json"sv))
+			return true;
+		for (const auto t : { "application/javascript"sv, "application/x-javascript"sv, "application/ecmascript"sv, "application/json"sv,
+				"application/xml"sv, "application/wasm"sv, "application/x-font-ttf"sv, "application/vnd.ms-fontobject"sv,
+				"font/ttf"sv, "font/otf"sv, "image/x-icon"sv, "image/vnd.microsoft.icon"sv, "image/bmp"sv })
+			if (mime == t)
+				return true;
+		return false;	// images, audio, video, archives and fonts that carry their own compression
+	}
+}
+
+void compression_policy::classify(std::string_view mime, bool compressible)
+{
+	mime = essence(mime);
+	if (auto t = _types.find(mime); t != _types.end())
+		t->second = compressible;
+	else
+		_types.emplace(mime, compressible);
+}
+
+bool compression_policy::by_type(std::string_view mime) const
+{
+	mime = essence(mime);
+	const auto t = _types.find(mime);
+	return t != _types.end() ? t->second : guess(mime);
+}
+
+bool compression_policy::worth_it(std::string_view mime, std::string_view body, size_t max_size) const
+{
+	return worth_it(mime, body.size(), body, max_size);
+}
+
+bool compression_policy::worth_it(std::string_view mime, size_t size, std::string_view sample, size_t max_size) const
+{
+	if (size < COMPRESS_MIN_SIZE || size > max_size || !by_type(mime))
+		return false;
+	return entropy(sample.substr(0, COMPRESS_PROBE_SIZE)) <= COMPRESS_MAX_ENTROPY;
+}
+
+bool compression_policy::parallel(size_t size) const
+{
+	return parallel_threshold && size >= parallel_threshold && size > parallel_block && std::thread::hardware_concurrency() > 1;
+}
+
+Violet::UniBuffer compression_policy::compress(std::string_view body, Violet::encoding e, int level) const
+{
+	Violet::UniBuffer out;
+	if (parallel(body.size()))
+		Violet::parallel_deflate(body, e, level, parallel_block, out);
+	else
+		Violet::deflater::local(e, level).write(body.data(), body.size(), out, Z_FINISH);
+	return out;
+}
+
+Violet::UniBuffer compression_policy::compress(const std::vector<std::string_view> &spans, size_t size, Violet::encoding e, int level) const
+{
+	if (parallel(size)) {
+		// one copy is cheap next to deflating it all on a single core
+		std::string body;
+		body.reserve(size);
+		for (const auto &v : spans)
+			body.append(v);
+		return compress(body, e, level);
+	}
+	Violet::UniBuffer out;
+	auto &d = Violet::deflater::local(e, level);
+	for (const auto &v : spans)
+		d.write(v.data(), v.size(), out);
+	d.finish(out);
+	return out;
+}
+
+float compression_policy::entropy(std::string_view sample)
+{
+	if (sample.empty())
+		return 0.f;
+	unsigned count[256] = {};
+	for (const unsigned char c : sample)
+		++count[c];
+	const float n = static_cast<float>(sample.size());
+	float e = 0.f;
+	for (const auto c : count)
+		if (c) {
+			const float p = c / n;
+			e -= p * std::log2(p);
+		}
+	return e;
+}
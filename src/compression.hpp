@@ -0,0 +1,71 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <map>
+#include <vector>
+#include "echo/buffers.hpp"
+
+// below this the encoding headers eat most of what could be saved
+#define COMPRESS_MIN_SIZE 256
+// dynamic responses above this are sent as they are
+#define COMPRESS_MAX_SIZE (4 << 20)
+// only the beginning of a body is looked at before deciding
+#define COMPRESS_PROBE_SIZE 4096
+// bits per byte, anything denser is compressed (or random) already
+#define COMPRESS_MAX_ENTROPY 7.2f
+// bodies from this size on are deflated in blocks across cores
+#define PARALLEL_DEFLATE_THRESHOLD (1 << 20)
+#define PARALLEL_DEFLATE_BLOCK (128 << 10)
+
+/*
+	Decides which responses are worth deflating.
+	MIME types are classified by content_types.txt ("ext mime compress|store"),
+	types without an explicit class are guessed from their name.
+*/
+class compression_policy {
+	std::map<std::string, bool, std::less<>> _types;
+
+public:
+	size_t parallel_threshold = PARALLEL_DEFLATE_THRESHOLD, parallel_block = PARALLEL_DEFLATE_BLOCK;
+
+	void classify(std::string_view mime, bool compressible);
+
+	bool by_type(std::string_view mime) const;
+
+	/* Type, size and a look at the first few KB of the body */
+	bool worth_it(std::string_view mime, std::string_view body, size_t max_size = COMPRESS_MAX_SIZE) const;
+
+	/* Same, for a body that isn't in one piece, sample is its beginning */
+	bool worth_it(std::string_view mime, size_t size, std::string_view sample, size_t max_size = COMPRESS_MAX_SIZE) const;
+
+	/* Whether a body of this size is deflated in blocks on the compression pool */
+	bool parallel(size_t size) const;
+
+	/* Compresses on this thread or, past the threshold, on the compression pool */
+	Violet::UniBuffer compress(std::string_view body, Violet::encoding e, int level = Z_DEFAULT_COMPRESSION) const;
+
+	/* Same, for a body in pieces: deflated piece by piece, or put together for the pool past the threshold */
+	Violet::UniBuffer compress(const std::vector<std::string_view> &spans, size_t size, Violet::encoding e, int level = Z_DEFAULT_COMPRESSION) const;
+
+	/* Shannon entropy of the byte histogram, in bits per byte */
+	static float entropy(std::string_view sample);
+};
@@ -30,7 +30,7 @@
 #include <numeric>
 
 #ifndef VIOLET_NO_COMPILE_COMPRESSION
-#include <zlib.h>
+#include "deflater.hpp"
 #endif
 
 #include "type.hpp"
@@ -123,8 +123,13 @@ namespace Violet
 
 #ifndef VIOLET_NO_COMPILE_COMPRESSION
 		template <class Container>
-		bool zlib(const char *in, const size_t in_size, Container &out, const bool compress, const bool gzip)
+		bool zlib(const char *in, const size_t in_size, Container &out, const bool compress, const bool gzip, const int level = Z_DEFAULT_COMPRESSION)
 		{
+			if (compress) {
+				out.clear();
+				deflater::local(gzip ? encoding::gzip : encoding::deflate, level).write(in, in_size, out, Z_FINISH);
+				return true;
+			}
 			size_t blocksize = in_size + 1000;
 			z_stream strm;
 			out.resize(blocksize);
@@ -136,26 +141,19 @@ namespace Violet
 			strm.next_out = reinterpret_cast<Bytef*>(out.data());
 			strm.avail_out = static_cast<unsigned int>(blocksize);
 
-			int ret = compress ?
-						(gzip ? deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) : deflateInit(&strm, Z_DEFAULT_COMPRESSION)) :
-						(gzip ? inflateInit2(&strm, 15 + 16) : inflateInit(&strm));
-
-			if (ret != Z_OK)
+			if (int ret = gzip ? inflateInit2(&strm, 15 + 16) : inflateInit(&strm); ret != Z_OK)
 				throw std::bad_alloc();
 			try {
 				while(true) {
-					ret = compress ? deflate(&strm, Z_FINISH) : inflate(&strm, Z_FINISH);
+					const int ret = inflate(&strm, Z_FINISH);
 					if(ret == Z_STREAM_ERROR || ret == Z_MEM_ERROR)
 						throw std::bad_alloc();
 					if(ret == Z_STREAM_END) {
-						if (compress)
-							deflateEnd(&strm);
-						else
-							inflateEnd(&strm);
+						inflateEnd(&strm);
 						out.resize(out.size() - strm.avail_out);
 						break;
 					}
-					if(!compress && (ret == Z_NEED_DICT || ret == Z_DATA_ERROR)) {
+					if(ret == Z_NEED_DICT || ret == Z_DATA_ERROR) {
 						inflateEnd(&strm);
 						return false;
 					}
@@ -167,10 +165,7 @@ namespace Violet
 					strm.avail_out = static_cast<unsigned int>(blocksize);
 				}
 			} catch(...) {
-				if (compress)
-					deflateEnd(&strm);
-				else
-					inflateEnd(&strm);
+				inflateEnd(&strm);
 				throw;
 			}
 			return true;
@@ -285,9 +280,9 @@ namespace Violet
 			return true;
 		}
 
-		static buffer zlib_compress(const view_t &data, bool gzip) {
+		static buffer zlib_compress(const view_t &data, bool gzip, int level = Z_DEFAULT_COMPRESSION) {
 			buffer retn;
-			internal::zlib(data.data(), data.size(), retn.mData, true, gzip);
+			internal::zlib(data.data(), data.size(), retn.mData, true, gzip, level);
 			return retn;
 		}
 
@@ -0,0 +1,84 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "byte_ranges.hpp"
+#include "misc.hpp"
+#include <algorithm>
+#include <charconv>
+
+using namespace std::string_view_literals;
+
+static bool parse_number(std::string_view s, size_t &out)
+{
+	const auto r = std::from_chars(s.data(), s.data() + s.size(), out);
+	return !s.empty() && r.ec == std::errc{} && r.ptr == s.data() + s.size();
+}
+
+bool Violet::parse_byte_ranges(std::string_view spec, const size_t size, std::vector<std::pair<size_t, size_t>> &out)
+{
+	if (spec.size() < 6 || __cis_compare(spec.substr(0, 6), "bytes="sv) != 0)
+		return false;
+	spec.remove_prefix(6);
+	bool any = false;
+	while (!spec.empty()) {
+		auto item = spec.substr(0, spec.find(','));
+		spec.remove_prefix(std::min(item.size() + 1, spec.size()));
+		remove_prefix_whitespace(item);
+		remove_suffix_whitespace(item);
+		if (item.empty())
+			continue;
+		const auto dash = item.find('-');
+		if (dash == std::string_view::npos)
+			return false;
+		any = true;
+		size_t first, last = size - 1;
+		if (dash == 0) {	// suffix, the final n bytes
+			size_t n;
+			if (!parse_number(item.substr(1), n))
+				return false;
+			if (!n || !size)
+				continue;
+			first = size - std::min(n, size);
+		}
+		else {
+			if (!parse_number(item.substr(0, dash), first))
+				return false;
+			if (dash + 1 < item.size()) {
+				size_t l;
+				if (!parse_number(item.substr(dash + 1), l) || l < first)
+					return false;
+				last = std::min(l, last);
+			}
+			if (first >= size)
+				continue;
+		}
+		out.emplace_back(first, last);
+	}
+	if (!any)
+		return false;
+	std::sort(out.begin(), out.end());
+	size_t n = 0;
+	for (size_t i = 1; i < out.size(); ++i)
+		if (out[i].first <= out[n].second + 1)
+			out[n].second = std::max(out[n].second, out[i].second);
+		else
+			out[++n] = out[i];
+	out.resize(std::min(out.size(), n + 1));
+	return true;
+}
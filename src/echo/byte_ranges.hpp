@@ -0,0 +1,33 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Violet
+{
+	/*
+		RFC 7233 byte-range-set against a representation of `size` bytes, as inclusive [first, last] pairs.
+		Returns false if the header is to be ignored, an empty set means nothing in it was satisfiable.
+		Overlapping and adjacent ranges are merged.
+	*/
+	bool parse_byte_ranges(std::string_view spec, const size_t size, std::vector<std::pair<size_t, size_t>> &out);
+}
@@ -0,0 +1,113 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <array>
+#include <memory>
+#include <climits>
+#include <algorithm>
+#include <new>
+#include <zlib.h>
+
+namespace Violet
+{
+	enum class encoding { deflate, gzip, raw };	// zlib wrapper, gzip wrapper, bare deflate
+
+	/*
+		Compression context that is reset instead of torn down, so the zlib state
+		(~256 KiB at default settings) is allocated once per thread and format.
+		Output is appended straight to the tail of any buffer with resize()/data()/size(),
+		e.g. the socket's output chain, and can be cut into Z_SYNC_FLUSH chunks.
+	*/
+	class deflater
+	{
+		z_stream _strm;
+		int _level;
+
+	public:
+		deflater(encoding e, int level = Z_DEFAULT_COMPRESSION) : _level(level) {
+			_strm.zalloc = Z_NULL;
+			_strm.zfree = Z_NULL;
+			_strm.opaque = Z_NULL;
+			const int bits = e == encoding::gzip ? 15 + 16 : e == encoding::raw ? -15 : 15;
+			if (deflateInit2(&_strm, level, Z_DEFLATED, bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+				throw std::bad_alloc();
+		}
+		~deflater() { deflateEnd(&_strm); }
+		deflater(const deflater &) = delete;
+		deflater &operator=(const deflater &) = delete;
+
+		/* The calling thread's stream for this format, reset and ready for a new body */
+		static deflater &local(encoding e, int level = Z_DEFAULT_COMPRESSION) {
+			thread_local std::array<std::unique_ptr<deflater>, 3> streams;
+			auto &d = streams[static_cast<size_t>(e)];
+			if (!d)
+				d = std::make_unique<deflater>(e, level);
+			else
+				d->reset(level);
+			return *d;
+		}
+
+		void reset(int level) {
+			deflateReset(&_strm);
+			if (level != _level && deflateParams(&_strm, level, Z_DEFAULT_STRATEGY) == Z_OK)
+				_level = level;
+		}
+
+		/* Primes a freshly reset stream with data that precedes the input (raw streams only) */
+		void dictionary(const void *data, size_t len) {
+			deflateSetDictionary(&_strm, static_cast<const Bytef *>(data), static_cast<uInt>(len));
+		}
+
+		/* Appends compressed input to out, flush is Z_NO_FLUSH, Z_SYNC_FLUSH or Z_FINISH */
+		template<class Container>
+		void write(const void *in, size_t len, Container &out, const int flush = Z_NO_FLUSH) {
+			auto src = static_cast<const Bytef *>(in);
+			do {
+				const auto step = static_cast<uInt>(std::min<size_t>(len, UINT_MAX));
+				_strm.next_in = const_cast<Bytef *>(src);
+				_strm.avail_in = step;
+				src += step;
+				len -= step;
+				const int f = len ? Z_NO_FLUSH : flush;
+				// the bound is exact enough for a single call, a flush may take one more round
+				size_t room = deflateBound(&_strm, step) + 16;
+				do {
+					const size_t old = out.size();
+					out.resize(old + room);
+					_strm.next_out = reinterpret_cast<Bytef *>(out.data() + old);
+					_strm.avail_out = static_cast<uInt>(room);
+					if (deflate(&_strm, f) == Z_STREAM_ERROR)
+						throw std::bad_alloc();
+					out.resize(old + room - _strm.avail_out);
+					room = 4096;
+				} while (_strm.avail_out == 0);
+			} while (len);
+		}
+
+		template<class Container>
+		inline void flush(Container &out) { write(nullptr, 0, out, Z_SYNC_FLUSH); }
+
+		template<class Container>
+		inline void finish(Container &out) { write(nullptr, 0, out, Z_FINISH); }
+
+		inline uLong total_in() const { return _strm.total_in; }
+		inline uLong total_out() const { return _strm.total_out; }
+	};
+}
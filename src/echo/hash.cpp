@@ -363,4 +363,51 @@ void Violet::SHA256::finish(hash_block& block, const unsigned int used)
 	memset(block.x, 0, 64);
 	for (unsigned int i = 0; i < 8; ++i)
 		result.w[i] = reverse_endianness_32(result.w[i]);
-}
\ No newline at end of file
+}
+
+namespace
+{
+	constexpr uint64_t xxh_p1 = 0x9E3779B185EBCA87ull, xxh_p2 = 0xC2B2AE3D27D4EB4Full, xxh_p3 = 0x165667B19E3779F9ull,
+			xxh_p4 = 0x85EBCA77C2B2AE63ull, xxh_p5 = 0x27D4EB2F165667C5ull;
+
+	inline uint64_t rotl64(uint64_t x, unsigned n) { return (x << n) | (x >> (64 - n)); }
+	inline uint64_t read64(const unsigned char *p) { uint64_t v; memcpy(&v, p, 8); return v; }	// little endian hosts only
+	inline uint32_t read32(const unsigned char *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+	inline uint64_t xxh_round(uint64_t acc, uint64_t in) { return rotl64(acc + in * xxh_p2, 31) * xxh_p1; }
+	inline uint64_t xxh_merge(uint64_t acc, uint64_t v) { return (acc ^ xxh_round(0, v)) * xxh_p1 + xxh_p4; }
+}
+
+uint64_t Violet::xxh64(const void *data, size_t len, uint64_t seed)
+{
+	auto p = static_cast<const unsigned char *>(data);
+	const auto end = p + len;
+	uint64_t h;
+	if (len >= 32) {
+		uint64_t v1 = seed + xxh_p1 + xxh_p2, v2 = seed + xxh_p2, v3 = seed, v4 = seed - xxh_p1;
+		for (const auto limit = end - 32; p <= limit; p += 32) {
+			v1 = xxh_round(v1, read64(p));
+			v2 = xxh_round(v2, read64(p + 8));
+			v3 = xxh_round(v3, read64(p + 16));
+			v4 = xxh_round(v4, read64(p + 24));
+		}
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = xxh_merge(xxh_merge(xxh_merge(xxh_merge(h, v1), v2), v3), v4);
+	}
+	else
+		h = seed + xxh_p5;
+	h += len;
+	for (; p + 8 <= end; p += 8)
+		h = rotl64(h ^ xxh_round(0, read64(p)), 27) * xxh_p1 + xxh_p4;
+	if (p + 4 <= end) {
+		h = rotl64(h ^ (read32(p) * xxh_p1), 23) * xxh_p2 + xxh_p3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+		h = rotl64(h ^ (*p * xxh_p5), 11) * xxh_p1;
+	h ^= h >> 33;
+	h *= xxh_p2;
+	h ^= h >> 29;
+	h *= xxh_p3;
+	return h ^ (h >> 32);
+}
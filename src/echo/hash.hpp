@@ -19,6 +19,8 @@
 
 #pragma once
 #include <memory.h>
+#include <cstdint>
+#include <cstddef>
 
 namespace Violet
 {
@@ -118,4 +120,7 @@ namespace Violet
 		void finish(hash_block&, const unsigned int used);
 		void operator++();
 	};
+
+	/* XXH64, fast and well distributed but not cryptographic (cache keys, entity tags) */
+	uint64_t xxh64(const void *data, size_t len, uint64_t seed = 0);
 }
\ No newline at end of file
@@ -0,0 +1,180 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "http_date.hpp"
+#include <cstring>
+
+using namespace std::string_view_literals;
+
+namespace
+{
+	constexpr char weekdays[] = "ThuFriSatSunMonTueWed";	// 1970-01-01 was a Thursday
+	constexpr char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+	// proleptic Gregorian calendar, days since 1970-01-01 (H. Hinnant's algorithms)
+	constexpr long long days_from_civil(long long y, unsigned m, unsigned d)
+	{
+		y -= m <= 2;
+		const long long era = (y >= 0 ? y : y - 399) / 400;
+		const unsigned yoe = static_cast<unsigned>(y - era * 400);
+		const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+		const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		return era * 146097 + static_cast<long long>(doe) - 719468;
+	}
+
+	inline void civil_from_days(long long z, long long &y, unsigned &m, unsigned &d)
+	{
+		z += 719468;
+		const long long era = (z >= 0 ? z : z - 146096) / 146097;
+		const unsigned doe = static_cast<unsigned>(z - era * 146097);
+		const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		const unsigned mp = (5 * doy + 2) / 153;
+		d = doy - (153 * mp + 2) / 5 + 1;
+		m = mp < 10 ? mp + 3 : mp - 9;
+		y = static_cast<long long>(yoe) + era * 400 + (m <= 2);
+	}
+
+	inline char * put2(char *p, unsigned v)
+	{
+		*p++ = static_cast<char>('0' + v / 10);
+		*p++ = static_cast<char>('0' + v % 10);
+		return p;
+	}
+
+	bool number(std::string_view &s, size_t digits, unsigned &out)
+	{
+		if (s.size() < digits)
+			return false;
+		out = 0;
+		for (size_t i = 0; i < digits; ++i) {
+			if (s[i] < '0' || s[i] > '9')
+				return false;
+			out = out * 10 + static_cast<unsigned>(s[i] - '0');
+		}
+		s.remove_prefix(digits);
+		return true;
+	}
+
+	bool literal(std::string_view &s, std::string_view l)
+	{
+		if (s.substr(0, l.size()) != l)
+			return false;
+		s.remove_prefix(l.size());
+		return true;
+	}
+
+	bool month(std::string_view &s, unsigned &out)
+	{
+		if (s.size() < 3)
+			return false;
+		for (unsigned i = 0; i < 12; ++i)
+			if (s.substr(0, 3) == std::string_view{ months + i * 3, 3 }) {
+				out = i + 1;
+				s.remove_prefix(3);
+				return true;
+			}
+		return false;
+	}
+
+	bool clock(std::string_view &s, unsigned &h, unsigned &mi, unsigned &sec)
+	{
+		return number(s, 2, h) && literal(s, ":"sv) && number(s, 2, mi) && literal(s, ":"sv) && number(s, 2, sec)
+				&& h < 24 && mi < 60 && sec < 61;
+	}
+}
+
+char * Violet::format_http_date(time_t t, char *out)
+{
+	const long long secs = static_cast<long long>(t);
+	long long days = secs / 86400, rem = secs % 86400;
+	if (rem < 0) {
+		rem += 86400;
+		--days;
+	}
+	long long y;
+	unsigned m, d;
+	civil_from_days(days, y, m, d);
+	char *p = out;
+	memcpy(p, weekdays + ((days % 7 + 7) % 7) * 3, 3);
+	p += 3;
+	*p++ = ',';
+	*p++ = ' ';
+	p = put2(p, d);
+	*p++ = ' ';
+	memcpy(p, months + (m - 1) * 3, 3);
+	p += 3;
+	*p++ = ' ';
+	const unsigned year = static_cast<unsigned>(y < 0 ? 0 : y > 9999 ? 9999 : y);
+	p = put2(put2(p, year / 100), year % 100);
+	*p++ = ' ';
+	p = put2(p, static_cast<unsigned>(rem / 3600));
+	*p++ = ':';
+	p = put2(p, static_cast<unsigned>(rem / 60 % 60));
+	*p++ = ':';
+	p = put2(p, static_cast<unsigned>(rem % 60));
+	memcpy(p, " GMT", 5);
+	return out;
+}
+
+bool Violet::parse_http_date(std::string_view s, time_t &out)
+{
+	unsigned d, m, y, h, mi, sec;
+	const auto comma = s.find(',');
+	if (comma != std::string_view::npos && (s.size() <= comma + 1 || s[comma + 1] != ' '))
+		return false;	// the weekday is always followed by a space
+	if (comma == 3) {	// Sun, 06 Nov 1994 08:49:37 GMT
+		s.remove_prefix(5);
+		if (!number(s, 2, d) || !literal(s, " "sv) || !month(s, m) || !literal(s, " "sv) || !number(s, 4, y)
+				|| !literal(s, " "sv) || !clock(s, h, mi, sec) || s != " GMT"sv)
+			return false;
+	}
+	else if (comma != std::string_view::npos && comma < 10) {	// Sunday, 06-Nov-94 08:49:37 GMT
+		s.remove_prefix(comma + 2);
+		if (!number(s, 2, d) || !literal(s, "-"sv) || !month(s, m) || !literal(s, "-"sv) || !number(s, 2, y)
+				|| !literal(s, " "sv) || !clock(s, h, mi, sec) || s != " GMT"sv)
+			return false;
+		y += y < 70 ? 2000 : 1900;	// the 50 year rule of RFC 7231 would be better, but servers sending these are from the 90s
+	}
+	else if (comma == std::string_view::npos && s.size() > 4) {	// Sun Nov  6 08:49:37 1994
+		s.remove_prefix(4);
+		if (!month(s, m) || !literal(s, " "sv))
+			return false;
+		// the day is padded with a space, not a zero
+		if (!(literal(s, " "sv) ? number(s, 1, d) : number(s, 2, d)) || !literal(s, " "sv) || !clock(s, h, mi, sec) || !literal(s, " "sv) || !number(s, 4, y) || !s.empty())
+			return false;
+	}
+	else
+		return false;
+	if (d < 1 || d > 31)
+		return false;
+	out = static_cast<time_t>(days_from_civil(y, m, d) * 86400 + h * 3600 + mi * 60 + sec);
+	return true;
+}
+
+const char * Violet::http_date_now()
+{
+	thread_local time_t last = -1;
+	thread_local char date[http_date_length + 1];
+	if (const time_t now = time(nullptr); now != last) {
+		format_http_date(now, date);
+		last = now;
+	}
+	return date;
+}
@@ -0,0 +1,41 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <ctime>
+#include <string_view>
+
+/*
+	HTTP dates without the C library: no locale, no timezone, no allocation.
+	Always UTC, as the protocol wants it.
+*/
+namespace Violet
+{
+	// "Sun, 06 Nov 1994 08:49:37 GMT"
+	constexpr size_t http_date_length = 29;
+
+	/* IMF-fixdate into out, which has to hold http_date_length + 1 chars, returns out */
+	char * format_http_date(time_t t, char *out);
+
+	/* IMF-fixdate, the obsolete RFC 850 form and asctime, as RFC 7231 asks of recipients */
+	bool parse_http_date(std::string_view s, time_t &out);
+
+	/* The current date, formatted at most once per second and thread */
+	const char * http_date_now();
+}
@@ -0,0 +1,237 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "multipart.hpp"
+#include "buffers.hpp"
+#include <cstring>
+
+using namespace Violet;
+using namespace std::string_view_literals;
+
+horspool::horspool(std::string_view needle)
+	: _needle(needle)
+{
+	const size_t m = _needle.size();
+	_shift.fill(m);
+	for (size_t i = 0; i + 1 < m; ++i)
+		_shift[static_cast<unsigned char>(_needle[i])] = m - 1 - i;
+}
+
+size_t horspool::find(const char *hay, const size_t len) const
+{
+	const size_t m = _needle.size();
+	if (m == 0 || len < m)
+		return npos;
+	const auto needle = _needle.data();
+	const unsigned char last = needle[m - 1];
+	for (size_t i = 0; i <= len - m; ) {
+		const unsigned char c = hay[i + m - 1];
+		if (c == last && memcmp(hay + i, needle, m - 1) == 0)
+			return i;
+		i += _shift[c];
+	}
+	return npos;
+}
+
+template<class F>
+void for_each_parameter(std::string_view s, F&&f)
+{
+	while (!s.empty()) {
+		auto item = s.substr(0, s.find(';'));
+		s.remove_prefix(std::min(item.size() + 1, s.size()));
+		remove_prefix_whitespace(item);
+		remove_suffix_whitespace(item);
+		const auto eq = item.find('=');
+		if (eq == std::string_view::npos) {
+			f(item, std::string_view{});
+			continue;
+		}
+		auto key = item.substr(0, eq), val = item.substr(eq + 1);
+		remove_suffix_whitespace(key);
+		remove_prefix_whitespace(val);
+		if (val.size() > 1 && val.front() == '\"' && val.back() == '\"')
+			val = val.substr(1, val.size() - 2);
+		f(key, val);
+	}
+}
+
+std::string_view multipart_parser::boundary_from_content_type(std::string_view content_type)
+{
+	std::string_view boundary;
+	bool is_multipart = false;
+	for_each_parameter(content_type, [&](std::string_view key, std::string_view val) {
+		if (val.data() == nullptr)
+			is_multipart = is_multipart || __cis_compare(key, "multipart/form-data"sv) == 0;
+		else if (__cis_compare(key, "boundary"sv) == 0)
+			boundary = val;
+	});
+	return is_multipart ? boundary : std::string_view{};
+}
+
+multipart_parser::multipart_parser(std::string_view boundary, part_handler_t on_part, size_t memory_limit)
+	: _delimiter("\r\n--" + std::string{ boundary }), _carry("\r\n"), _on_part(std::move(on_part)), _memory_left(memory_limit)
+{
+	// the very first delimiter isn't preceded by CRLF, hence the primed carry
+	if (boundary.empty() || boundary.size() > 70)
+		_state = State::Error;
+}
+
+bool multipart_parser::emit(const char *data, const size_t len)
+{
+	if (len) std::visit([this, data, len](auto &&s) {
+		using sink_type = std::decay_t<decltype(s)>;
+		if constexpr (std::is_same_v<sink_type, std::string *>) {
+			if (len > _memory_left) {
+				_state = State::Error;
+				return;
+			}
+			_memory_left -= len;
+			s->append(data, len);
+		}
+		else if constexpr (std::is_same_v<sink_type, FILE *>)
+			fwrite(data, 1, len, s);
+	}, _sink);
+	return _state != State::Error;
+}
+
+void multipart_parser::open_part()
+{
+	part p;
+	std::string_view h{ _headers };
+	while (!h.empty()) {
+		auto line = h.substr(0, h.find("\r\n"sv));
+		h.remove_prefix(std::min(line.size() + 2, h.size()));
+		const auto colon = line.find(':');
+		if (colon == std::string_view::npos)
+			continue;
+		auto key = line.substr(0, colon), val = line.substr(colon + 1);
+		remove_suffix_whitespace(key);
+		remove_prefix_whitespace(val);
+		if (__cis_compare(key, "content-disposition"sv) == 0)
+			for_each_parameter(val, [&p](std::string_view k, std::string_view v) {
+				if (k == "name"sv)
+					p.name.assign(v);
+				else if (k == "filename"sv)
+					p.filename.assign(v);
+			});
+		else if (__cis_compare(key, "content-type"sv) == 0)
+			p.content_type.assign(val);
+	}
+	_headers.clear();
+	_sink = _on_part ? _on_part(p) : sink_t{};
+}
+
+size_t multipart_parser::consume(const char * const data, const size_t len)
+{
+	size_t pos = 0;
+	while (pos < len) {
+		const auto p = data + pos;
+		const auto n = len - pos;
+		switch (_state) {
+		case State::Preamble:
+		case State::Body:
+			if (const auto i = _delimiter.find(p, n); i != horspool::npos) {
+				if (_state == State::Body) {
+					if (!emit(p, i))
+						return len;
+					_sink = sink_t{};
+				}
+				pos += i + _delimiter.size();
+				_state = State::Delimiter;
+			}
+			else {
+				// whatever might still turn out to be a delimiter stays in the carry
+				const size_t keep = std::min(n, _delimiter.size() - 1);
+				if (_state == State::Body && !emit(p, n - keep))
+					return len;
+				return pos + n - keep;
+			}
+			break;
+
+		case State::Delimiter:
+			if (*p == ' ' || *p == '\t') {	// transport padding
+				++pos;
+				break;
+			}
+			if (n < 2)
+				return pos;
+			if (p[0] == '-' && p[1] == '-') {
+				_state = State::Finished;
+				return len;
+			}
+			if (p[0] != '\r' || p[1] != '\n') {
+				_state = State::Error;
+				return len;
+			}
+			pos += 2;
+			_state = State::Headers;
+			break;
+
+		case State::Headers: {
+			const size_t old = _headers.size();
+			_headers.append(p, std::min(n, max_header_size - old));
+			if (_headers.size() < 2)
+				return len;
+			size_t e = 0, skip = 2;
+			if (_headers[0] != '\r' || _headers[1] != '\n') {	// otherwise the part has no headers at all
+				e = _headers.find("\r\n\r\n"sv, old > 3 ? old - 3 : 0);
+				skip = 4;
+			}
+			if (e == std::string::npos) {
+				if (_headers.size() >= max_header_size)
+					_state = State::Error;
+				return len;
+			}
+			pos += e + skip - old;
+			_headers.resize(e);
+			open_part();
+			_state = State::Body;
+			break;
+		}
+
+		case State::Finished:
+		case State::Error:
+			return len;
+		}
+	}
+	return pos;
+}
+
+void multipart_parser::feed(const char *data, size_t len)
+{
+	// the carry is topped up with at most one delimiter length so matches across chunks are found
+	while (len > 0 && !_carry.empty()) {
+		const size_t take = std::min(len, _delimiter.size()), old = _carry.size();
+		_carry.append(data, take);
+		const size_t used = consume(_carry.data(), _carry.size());
+		if (used < old) {	// the input was too short to decide anything
+			_carry.erase(0, used);
+			data += take;
+			len -= take;
+			continue;
+		}
+		_carry.clear();
+		data += used - old;
+		len -= used - old;
+	}
+	if (len > 0) {
+		const size_t used = consume(data, len);
+		_carry.assign(data + used, len - used);
+	}
+}
@@ -0,0 +1,92 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdio>
+#include <array>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <functional>
+
+namespace Violet
+{
+	/* Boyer-Moore-Horspool needle, the shift table is built once per boundary */
+	class horspool {
+		std::string _needle;
+		std::array<size_t, 256> _shift;
+
+	public:
+		static constexpr size_t npos = size_t(-1);
+
+		horspool() = default;
+		explicit horspool(std::string_view needle);
+
+		size_t find(const char *hay, const size_t len) const;
+
+		inline size_t size() const { return _needle.size(); }
+		inline std::string_view get_string() const { return _needle; }
+	};
+
+	/*
+		Single pass multipart/form-data parser.
+		Body bytes are fed as they arrive, every part is handed to a sink picked by the part handler.
+		At most one delimiter length of input (or the part headers) is ever held back.
+	*/
+	class multipart_parser {
+	public:
+		struct part {
+			std::string name, filename, content_type;
+		};
+
+		// std::monostate discards the part, std::string collects it in memory, FILE streams it out
+		using sink_t = std::variant<std::monostate, std::string *, FILE *>;
+		using part_handler_t = std::function<sink_t(const part &)>;
+
+		enum class State { Preamble, Delimiter, Headers, Body, Finished, Error };
+
+		static constexpr size_t max_header_size = 8192;
+
+	private:
+		horspool _delimiter;	// "\r\n--" + boundary
+		std::string _carry;		// undecided tail of the previous chunk
+		std::string _headers;
+		sink_t _sink;
+		part_handler_t _on_part;
+		size_t _memory_left;	// bytes std::string sinks may still take
+		State _state = State::Preamble;
+
+		size_t consume(const char *data, const size_t len);
+		bool emit(const char *data, const size_t len);
+		void open_part();
+
+	public:
+		multipart_parser(std::string_view boundary, part_handler_t on_part, size_t memory_limit = size_t(-1));
+
+		void feed(const char *data, size_t len);
+
+		/* Returns true if the closing delimiter has been reached */
+		inline bool finish() const { return _state == State::Finished; }
+
+		inline State get_state() const { return _state; }
+
+		/* Extracts the (possibly quoted) boundary parameter, empty if the type isn't multipart/form-data */
+		static std::string_view boundary_from_content_type(std::string_view content_type);
+	};
+}
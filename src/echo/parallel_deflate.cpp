@@ -0,0 +1,74 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "parallel_deflate.hpp"
+
+using namespace Violet;
+
+compression_pool::compression_pool(unsigned threads)
+{
+	_threads.reserve(threads);
+	for (unsigned i = 0; i < threads; ++i)
+		_threads.emplace_back(&compression_pool::run, this);
+}
+
+compression_pool::~compression_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_cv.notify_all();
+	for (auto &t : _threads)
+		t.join();
+}
+
+compression_pool &compression_pool::get()
+{
+	static compression_pool pool{ std::max(std::thread::hardware_concurrency(), 2u) - 1 };
+	return pool;
+}
+
+void compression_pool::run()
+{
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_cv.wait(lock, [this] { return _stop || !_jobs.empty(); });
+			if (_jobs.empty())
+				return;
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+		job();
+	}
+}
+
+std::future<void> compression_pool::submit(std::function<void()> job)
+{
+	auto task = std::make_shared<std::packaged_task<void()>>(std::move(job));
+	auto f = task->get_future();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.emplace_back([task] { (*task)(); });
+	}
+	_cv.notify_one();
+	return f;
+}
@@ -0,0 +1,131 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "deflater.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+
+namespace Violet
+{
+	/* A fixed set of threads shared by everyone who splits compression across cores */
+	class compression_pool
+	{
+		std::vector<std::thread> _threads;
+		std::deque<std::function<void()>> _jobs;
+		std::mutex _mutex;
+		std::condition_variable _cv;
+		bool _stop = false;
+
+		explicit compression_pool(unsigned threads);
+		void run();
+
+	public:
+		~compression_pool();
+
+		/* Started on first use with one thread less than there are cores, the caller makes up for it */
+		static compression_pool &get();
+
+		inline size_t size() const { return _threads.size(); }
+
+		std::future<void> submit(std::function<void()> job);
+	};
+
+	/*
+		pigz-style deflate: the input is cut into blocks that are compressed on the pool, each one primed
+		with the last 32 KiB of its predecessor and ended on a byte boundary with a sync flush.
+		The raw pieces are stitched behind a single header and the per-block checksums are combined,
+		so the result is an ordinary zlib or gzip stream.
+	*/
+	template<class Container>
+	void parallel_deflate(std::string_view in, encoding e, int level, size_t block_size, Container &out)
+	{
+		constexpr size_t window = 32 << 10;
+		block_size = std::max(block_size, window);
+		const size_t blocks = std::max<size_t>(1, (in.size() + block_size - 1) / block_size);
+		std::vector<std::string> parts(blocks);
+		std::vector<uLong> sums(blocks);
+
+		const auto job = [&, e, level, block_size, blocks](const size_t i) {
+			const auto block = in.substr(i * block_size, block_size);
+			auto &d = deflater::local(encoding::raw, level);
+			if (i)
+				d.dictionary(block.data() - window, window);
+			d.write(block.data(), block.size(), parts[i], i + 1 < blocks ? Z_SYNC_FLUSH : Z_FINISH);
+			const auto data = reinterpret_cast<const Bytef *>(block.data());
+			sums[i] = e == encoding::gzip ? crc32(crc32(0, Z_NULL, 0), data, static_cast<uInt>(block.size()))
+					: adler32(adler32(0, Z_NULL, 0), data, static_cast<uInt>(block.size()));
+		};
+
+		std::vector<std::future<void>> pending;
+		pending.reserve(blocks);
+		for (size_t i = 1; i < blocks; ++i)
+			pending.emplace_back(compression_pool::get().submit([&job, i] { job(i); }));
+		std::exception_ptr failure;
+		try { job(0); }
+		catch (...) { failure = std::current_exception(); }
+		// every job has to be done before the locals they point to go away
+		for (auto &p : pending)
+			try { p.get(); }
+			catch (...) { if (!failure) failure = std::current_exception(); }
+		if (failure)
+			std::rethrow_exception(failure);
+
+		uLong sum = sums[0];
+		size_t length = 0;
+		for (size_t i = 0; i < blocks; ++i) {
+			length += parts[i].size();
+			if (i)
+				sum = e == encoding::gzip ? crc32_combine(sum, sums[i], static_cast<z_off_t>(std::min(block_size, in.size() - i * block_size)))
+						: adler32_combine(sum, sums[i], static_cast<z_off_t>(std::min(block_size, in.size() - i * block_size)));
+		}
+
+		const size_t old = out.size();
+		const size_t header = e == encoding::gzip ? 10 : e == encoding::deflate ? 2 : 0,
+				trailer = e == encoding::gzip ? 8 : e == encoding::deflate ? 4 : 0;
+		out.resize(old + header + length + trailer);
+		auto p = reinterpret_cast<unsigned char *>(out.data() + old);
+		if (e == encoding::gzip) {
+			static constexpr unsigned char gzip_header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+			p = std::copy(std::begin(gzip_header), std::end(gzip_header), p);
+		}
+		else if (e == encoding::deflate) {
+			*p++ = 0x78;
+			*p++ = level == 1 ? 0x01 : level >= 2 && level <= 5 ? 0x5e : level >= 7 ? 0xda : 0x9c;
+		}
+		for (const auto &s : parts)
+			p = std::copy(s.begin(), s.end(), p);
+		if (e == encoding::gzip) {
+			const uLong isize = static_cast<uLong>(in.size());
+			for (int i = 0; i < 4; ++i)
+				*p++ = static_cast<unsigned char>(sum >> (8 * i));
+			for (int i = 0; i < 4; ++i)
+				*p++ = static_cast<unsigned char>(isize >> (8 * i));
+		}
+		else if (e == encoding::deflate)
+			for (int i = 0; i < 4; ++i)
+				*p++ = static_cast<unsigned char>(sum >> (24 - 8 * i));
+	}
+}
@@ -40,6 +40,7 @@ inline auto _win32_make_nonblocking(int s, bool dontblock) {
 #define SOCKET_MAKEBLOCKING(s) _win32_make_nonblocking((s), false)
 #else
 #include <unistd.h>
+#include <sys/uio.h>
 #define SOCKET_MAKENONBLOCKING(s) fcntl((s), F_SETFL, O_NONBLOCK)
 #define SOCKET_MAKEBLOCKING(s) fcntl((s), F_SETFL, 0x0)
 #endif
@@ -54,6 +55,7 @@ inline auto _win32_make_nonblocking(int s, bool dontblock) {
 #endif
 
 #define READ_BUFFER_SIZE 1020
+#define READ_BACKLOG_LIMIT 65536	// per update_read() call, the rest waits in the kernel
 
 using namespace Violet;
 using namespace std::string_view_literals;
@@ -217,6 +219,7 @@ __RwSocket ListeningSocket::accept() {
 		if (ctx) {
 			socket.mSsl_s = SSL_new(ctx);
 			if (socket.mSsl_s != nullptr) {
+				SSL_set_mode(socket.mSsl_s, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);	// retries may come from another record buffer
 				SSL_set_fd(socket.mSsl_s, socket.mSocket);
 				SSL_set_accept_state(socket.mSsl_s);
 				SSL_accept(socket.mSsl_s);
@@ -392,7 +395,7 @@ void BaseSocket::update_read() {
 	// reading
 	if(mState == State::connected) {
 		char buffer[READ_BUFFER_SIZE];
-		while(true) {
+		for(size_t total = 0; total < READ_BACKLOG_LIMIT;) {
 			// try to receive data
 			int result;
 #ifdef VIOLET_SOCKET_USE_OPENSSL
@@ -428,6 +431,7 @@ void BaseSocket::update_read() {
 			
 			if(result > 0) {
 				append_read(buffer, result);
+				total += result;
 				
 				if(static_cast<size_t>(result) < sizeof(buffer))
 					break;
@@ -441,12 +445,41 @@ void BaseSocket::update_read() {
 }
 
 void BaseSocket::update_write() {
-	if((mState == State::connected || mState == State::closed) && can_write()) {
+	/*
+		Keeps going until the kernel stops taking data. Queued pieces go out together, so a response head
+		and a small body share a segment (or a TLS record) instead of the body waiting on Nagle for the ACK.
+	*/
+	std::string_view spans[WRITE_GATHER_LIMIT];
+	// whatever was read from memory that went bad is garbage, the peer must not take it for the real thing
+	const auto faulted = [this] {
+		if (!write_faulted())
+			return false;
+		close(mSocket);
+		mState = State::error;
+		return true;
+	};
+	while((mState == State::connected || mState == State::closed) && can_write()) {
+		if (faulted())
+			return;
 		// try to send data
 		int result;
-		const auto [out, size] = get_write();
+		const size_t count = get_write(spans);
+		size_t size = 0;
 #ifdef VIOLET_SOCKET_USE_OPENSSL
 		if (mSsl_s) {
+			// a single buffer per SSL_write, small pieces are copied into one record (the SSL allows the buffer to move)
+			char record[TLS_RECORD_SIZE];
+			const char *out = spans[0].data();
+			size = std::min<size_t>(spans[0].size(), 1 << 30);	// mapped files can exceed int
+			if (count > 1 && size < sizeof(record)) {
+				size = 0;
+				for (size_t i = 0; i < count && size < sizeof(record); ++i) {
+					const size_t n = std::min(spans[i].size(), sizeof(record) - size);
+					memcpy(record + size, spans[i].data(), n);
+					size += n;
+				}
+				out = record;
+			}
 			result = SSL_write(mSsl_s, out, static_cast<int>(size));
 			if (result < 0) {
 				auto e = SSL_get_error(mSsl_s, result);
@@ -463,7 +496,18 @@ void BaseSocket::update_write() {
 		else
 #endif
 		{
-			result = send(mSocket, out, size, 0);
+#ifdef WIN32
+			size = std::min<size_t>(spans[0].size(), 1 << 30);
+			result = send(mSocket, spans[0].data(), size, 0);
+#else
+			iovec iov[WRITE_GATHER_LIMIT];
+			for (size_t i = 0; i < count; ++i) {
+				iov[i].iov_base = const_cast<char *>(spans[i].data());
+				iov[i].iov_len = std::min<size_t>(spans[i].size(), (1 << 30) - size);
+				size += iov[i].iov_len;
+			}
+			result = static_cast<int>(writev(mSocket, iov, static_cast<int>(count)));
+#endif
 			if(result == SOCKET_ERROR) {
 				if(errno == EWOULDBLOCK) {
 					return;
@@ -473,6 +517,8 @@ void BaseSocket::update_write() {
 				return;
 			}
 		}
+		if (faulted())
+			return;
 		write_confirm_sent(result);
 		
 		// shut down?
@@ -480,7 +526,9 @@ void BaseSocket::update_write() {
 			shutdown(mSocket, SHUT_WR);
 			mState = State::closed;
 		}
-		
+
+		if(static_cast<size_t>(result) < size)
+			break;
 	}
 	
 }
@@ -509,58 +557,6 @@ std::string BaseSocket::get_peer_address() const {
 
 #ifndef VIOLET_NO_COMPILE_HTTP
 
-typedef std::array<unsigned char, 256> UrlEncodeTable;
-
-constexpr UrlEncodeTable Create_HttpRequest_UrlEncodeTable() {
-	UrlEncodeTable table { 0x0 };
-	//const UrlEncodeTable &fake_const_table = table;
-	for(const char *p = "!*'();:@&=+$,/?#[]%"; *p != '\0'; ++p) { table[static_cast<unsigned char>(*p)] = 1; }
-	for(const char *p = "-_.~"; *p != '\0'; ++p) { table[static_cast<unsigned char>(*p)] = 2; }
-	for(char c = '0'; c <= '9'; ++c) { table[static_cast<unsigned char>(c)] = 2; }
-	for(char c = 'a'; c <= 'z'; ++c) { table[static_cast<unsigned char>(c)] = 2; }
-	for(char c = 'A'; c <= 'Z'; ++c) { table[static_cast<unsigned char>(c)] = 2; }
-	return table;
-}
-
-std::string HttpRequest::url_encode(const std::string_view & str, bool keepspecialchars) {
-	constexpr static const auto httprequest_urlencodetable = Create_HttpRequest_UrlEncodeTable();
-	const char *hextable = "0123456789abcdef";
-	unsigned char threshold = keepspecialchars ? 1 : 2;
-	std::string ret;
-	ret.reserve(str.size() * 2);
-	for(auto c : str)
-		if(httprequest_urlencodetable[static_cast<unsigned char>(c)] >= threshold) {
-			ret.push_back(c);
-		} else {
-			ret.push_back('%');
-			ret.push_back(hextable[static_cast<unsigned char>(c) >> 4]);
-			ret.push_back(hextable[static_cast<unsigned char>(c) & 15]);
-		}
-	return ret;
-}
-
-//template<class T, typename = std::enable_if_t<std::is_convertible_v<T, std::string_view>>>
-std::string HttpRequest::url_decode(const std::string_view& str) {
-	std::string ret;
-	for(size_t i = 0; i < str.length(); ++i) {
-		unsigned char c = static_cast<unsigned char>(str[i]);
-		if(c == '%' && i + 2 < str.length()) {
-			unsigned char a = static_cast<unsigned char>(str[++i]);
-			unsigned char b = static_cast<unsigned char>(str[++i]);
-			ret.push_back
-				(((('0' <= a && a <= '9')? a - '0' :
-				  ('a' <= a && a <= 'f')? 10 + a - 'a' :
-				  ('A' <= a && a <= 'F')? 10 + a - 'A' : 0) << 4) |
-				 (('0' <= b && b <= '9')? b - '0' :
-				  ('a' <= b && b <= 'f')? 10 + b - 'a' :
-				  ('A' <= b && b <= 'F')? 10 + b - 'A' : 0));
-		} else {
-			ret.push_back(c);
-		}
-	}
-	return ret;
-}
-
 void HttpRequest::parse_cookies(std::string s) {
 	parse_cookies(s.data(), s.length());
 }
@@ -619,12 +615,10 @@ void HttpRequest::parse_cookies(char *s, size_t len)
 				break; // for now
 			}
 			else if (!max_age_has_prec && caseinsensitive_equal<char>(it->first, "Expires")) {
-				//auto sdt = static_cast<std::string>(it.second);
-				tm modt;
-				memset(&modt, 0, sizeof(tm));
-				strptime(it->second.data(), DTFORMAT, &modt);
-				r.expi = std::chrono::system_clock::from_time_t(mktime(&modt));
-				r.persistent = true;
+				if (time_t t; parse_http_date(it->second, t)) {
+					r.expi = std::chrono::system_clock::from_time_t(t);
+					r.persistent = true;
+				}
 			}
 		}
 	}
@@ -699,7 +693,7 @@ void HttpRequest::connect(const std::string_view& url)
 
 	// write HTTP request
 	mSock << (post_request ? "POST " : "GET ")
-		<< url_encode(file, true) << " HTTP/1.1\r\n";
+		<< Violet::url_encode(file, true) << " HTTP/1.1\r\n";
 
 	requestheaders.try_emplace("Host"sv, host);
 
@@ -799,7 +793,7 @@ void HttpRequest::connect(const std::string_view& url)
 				else nfirst = true;
 				sendmessagebody += it.name;
 				sendmessagebody += '=';
-				sendmessagebody += url_encode(it.value);
+				Violet::url_encode(sendmessagebody, it.value);
 			}
 			
 			// set the content type
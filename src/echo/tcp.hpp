@@ -19,8 +19,13 @@
 
 #pragma once
 #include "buffers.hpp"
+#include "url.hpp"
+#include "http_date.hpp"
 
 #include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
 #include <map>
 #include <variant>
 #include <optional>
@@ -62,6 +67,9 @@ namespace Violet {
 	#define VIOLET_CUSTOM_USER_AGENT "VioletEcho/0.4"
 #endif
 
+#define WRITE_GATHER_LIMIT 16	// queued pieces of output handed to a single writev()
+#define TLS_RECORD_SIZE 16384	// small pieces are copied together up to a full record
+
 namespace Violet
 {
 	enum class State {
@@ -125,8 +133,11 @@ namespace Violet
 
 		virtual void append_read(const char *in, size_t size) = 0;
 		virtual bool can_write() const = 0;
-		virtual std::pair<const char *, size_t> get_write() = 0;
+		/* Up to WRITE_GATHER_LIMIT pieces of output in the order they go out, returns how many */
+		virtual size_t get_write(std::string_view *out) = 0;
 		virtual void write_confirm_sent(size_t bytes) = 0;
+		/* Queued memory went bad (a mapped file was cut short), the transfer can't be completed */
+		virtual bool write_faulted() const { return false; }
 
 	public:
 		BaseSocket() = default;
@@ -161,27 +172,87 @@ namespace Violet
 		using buffer_t = Violet::buffer<TempStorage>;
 		buffer_t mReadbuffer, mWritebuffer;
 
+		/*
+			Output queued behind mWritebuffer, either copied bytes or a reference
+			to memory kept alive by its owner (e.g. a mapped file shared between connections)
+		*/
+		struct chunk {
+			std::shared_ptr<const void> owner;
+			std::string_view view;	// only for referenced memory
+			buffer_t copy;
+			const std::atomic<bool> *fault = nullptr;	// set by the owner if view can't be trusted anymore
+
+			inline std::string_view get_string() const {
+				return owner ? view : std::string_view{ copy.data(), copy.size() }.substr(copy.get_pos());
+			}
+		};
+		std::deque<chunk> mChain;
+
 		void reset() {
 			mReadbuffer.clear();
 			mWritebuffer.clear();
+			mChain.clear();
 			BaseSocket::reset();
 		}
 	private:	
 		void append_read(const char *in, size_t size) { mReadbuffer.write_data(in, size); }
 
-		bool can_write() const { return !mWritebuffer.is_at_end(); }
+		bool can_write() const { return !mWritebuffer.is_at_end() || !mChain.empty(); }
+
+		size_t get_write(std::string_view *out) {
+			size_t n = 0;
+			if (!mWritebuffer.is_at_end()) {
+				const auto v = mWritebuffer.get_string_current();
+				out[n++] = { v.data(), v.size() * sizeof(typename buffer_t::value_type) };
+			}
+			for (auto it = mChain.begin(); it != mChain.end() && n < WRITE_GATHER_LIMIT; ++it)
+				out[n++] = it->get_string();
+			return n;
+		}
 
-		std::pair<const char *, size_t> get_write() { return std::make_pair<const char *, size_t>(mWritebuffer.data(), mWritebuffer.size() * sizeof(typename buffer_t::value_type)); }
+		bool write_faulted() const {
+			size_t n = 0;
+			for (auto it = mChain.begin(); it != mChain.end() && n < WRITE_GATHER_LIMIT; ++it, ++n)
+				if (it->fault && it->fault->load(std::memory_order_relaxed))
+					return true;
+			return false;
+		}
 
 		void write_confirm_sent(size_t bytes) {
-			mWritebuffer.set_pos(mWritebuffer.get_pos() + bytes);
-			const size_t p = mWritebuffer.get_pos();
-			if(p > mWritebuffer.length() / 4) {
-				memmove(mWritebuffer.data(), mWritebuffer.data() + p, mWritebuffer.length() - p);
-				mWritebuffer.set_pos(0);
-				mWritebuffer.resize(mWritebuffer.length() - p);
+			if (!mWritebuffer.is_at_end()) {
+				const size_t n = std::min(bytes, mWritebuffer.length() - mWritebuffer.get_pos());
+				bytes -= n;
+				mWritebuffer.set_pos(mWritebuffer.get_pos() + n);
+				const size_t p = mWritebuffer.get_pos();
+				if (mWritebuffer.is_at_end())
+					mWritebuffer.clear();
+				else if(p > mWritebuffer.length() / 4) {
+					memmove(mWritebuffer.data(), mWritebuffer.data() + p, mWritebuffer.length() - p);
+					mWritebuffer.set_pos(0);
+					mWritebuffer.resize(mWritebuffer.length() - p);
+				}
+			}
+			while (bytes > 0 && !mChain.empty()) {
+				auto &c = mChain.front();
+				const size_t n = std::min(bytes, c.get_string().size());
+				bytes -= n;
+				if (c.owner)
+					c.view.remove_prefix(n);
+				else
+					c.copy.set_pos(c.copy.get_pos() + n);
+				if (c.get_string().empty())
+					mChain.pop_front();
 			}
 		}
+
+		/* Where copied output goes, behind any queued reference */
+		buffer_t &tail() {
+			if (mChain.empty())
+				return mWritebuffer;
+			if (mChain.back().owner)
+				mChain.emplace_back();
+			return mChain.back().copy;
+		}
 	public:
 
 		auto get_read_data() const { return mReadbuffer.get_string_current(); }
@@ -191,13 +262,19 @@ namespace Violet
 		template<class A>
 		void write(A && data) {
 			if(!mShouldClose && mState != State::error) {
+				auto &b = tail();
 				if(mUseSafeHeader)
-					mWritebuffer.write_utfx(data.size());
-				mWritebuffer.template write<A>(data);
+					b.write_utfx(data.size());
+				b.template write<A>(data);
 			}
 		}
 
-		size_t get_write_data_length() const { return mWritebuffer.length() - mWritebuffer.get_pos(); }
+		size_t get_write_data_length() const {
+			size_t n = mWritebuffer.length() - mWritebuffer.get_pos();
+			for (auto &c : mChain)
+				n += c.get_string().size();
+			return n;
+		}
 		
 		void dump_data(size_t length) {
 			mReadbuffer.set_pos(mReadbuffer.get_pos() + length);
@@ -243,8 +320,21 @@ namespace Violet
 
 		template<class A>
 		buffer_t &operator<<(A&&x) {
-			mWritebuffer.template write<std::decay_t<A>>(x);
-			return mWritebuffer;
+			auto &b = tail();
+			b.template write<std::decay_t<A>>(x);
+			return b;
+		}
+
+		/* Copied output goes here, e.g. a deflater can append to it in place */
+		inline buffer_t &output() { return tail(); }
+
+		/*
+			Queues memory without copying it, owner is held until the last byte is sent.
+			If fault gets set while any of it is still queued the connection is dropped.
+		*/
+		void write_shared(std::shared_ptr<const void> owner, std::string_view data, const std::atomic<bool> *fault = nullptr) {
+			if (!data.empty() && !mShouldClose && mState != State::error)
+				mChain.push_back({ std::move(owner), data, {}, fault });
 		}
 		
 		// Returns true if a message was read
@@ -293,7 +383,10 @@ namespace Violet
 
 			bool can_write() const { return request.size() > 0; }
 
-			std::pair<const char *, size_t> get_write() { return std::make_pair<const char *, size_t>(request.c_str(), request.length()); }
+			size_t get_write(std::string_view *out) {
+				out[0] = request;
+				return 1;
+			}
 
 			void write_confirm_sent(size_t bytes) {
 				if (bytes >= request.length())
@@ -472,8 +565,8 @@ namespace Violet
 		requestheaders, responseheaders;
 		std::map<std::string, Cookie> cookies;
 
-		static std::string url_encode(const std::string_view& str, bool keepspecialchars = false);
-		static std::string url_decode(const std::string_view& str);
+		static inline std::string url_encode(const std::string_view& str, bool keepspecialchars = false) { return Violet::url_encode(str, keepspecialchars); }
+		static inline std::string url_decode(const std::string_view& str) { return Violet::url_decode(str); }
 
 		void reset();
 		bool update();
@@ -495,14 +588,12 @@ namespace Violet
 	public:
 		template<class B>
 		void save_cookies(B &b) const {
-			char dt[64];
+			char dt[http_date_length + 1];
 			for (auto&&it : cookies)
 				if (it.second.persistent) {
-					const auto tt = std::chrono::system_clock::to_time_t(it.second.expi);
-					tm gmt = *gmtime(&tt);
-					strftime(dt, 64, DTFORMAT, &gmt);
+					format_http_date(std::chrono::system_clock::to_time_t(it.second.expi), dt);
 					b << it.first << char('=') << it.second.value << "; EXPIRES=";
-					b.write_data(dt, strlen(dt));
+					b.write_data(dt, http_date_length);
 					b.write_crlf();
 				}
 		}
@@ -0,0 +1,160 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "url.hpp"
+#include <array>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace Violet;
+
+typedef std::array<unsigned char, 256> UrlEncodeTable;
+
+// 2 - unreserved, 1 - reserved (kept on request), 0 - always escaped
+constexpr UrlEncodeTable Create_UrlEncodeTable() {
+	UrlEncodeTable table { 0x0 };
+	for(const char *p = "!*'();:@&=+$,/?#[]%"; *p != '\0'; ++p) { table[static_cast<unsigned char>(*p)] = 1; }
+	for(const char *p = "-_.~"; *p != '\0'; ++p) { table[static_cast<unsigned char>(*p)] = 2; }
+	for(char c = '0'; c <= '9'; ++c) { table[static_cast<unsigned char>(c)] = 2; }
+	for(char c = 'a'; c <= 'z'; ++c) { table[static_cast<unsigned char>(c)] = 2; }
+	for(char c = 'A'; c <= 'Z'; ++c) { table[static_cast<unsigned char>(c)] = 2; }
+	return table;
+}
+
+constexpr static const auto url_encode_table = Create_UrlEncodeTable();
+
+inline int hex_value(const unsigned char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return 10 + c - 'a';
+	if (c >= 'A' && c <= 'F') return 10 + c - 'A';
+	return -1;
+}
+
+/* Length of the prefix free of '%' (and '+' for form data) */
+inline size_t plain_run(const char *p, const size_t n, bool form_data)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i pct = _mm_set1_epi8('%'), plus = _mm_set1_epi8(form_data ? '+' : '%');
+	for (; i + 16 <= n; i += 16) {
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+		if (const int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, pct), _mm_cmpeq_epi8(x, plus))))
+			return i + __builtin_ctz(m);
+	}
+#endif
+	for (; i < n; ++i)
+		if (p[i] == '%' || (form_data && p[i] == '+'))
+			break;
+	return i;
+}
+
+/* Length of the alphanumeric prefix, the bulk of any url */
+inline size_t alnum_run(const char *p, const size_t n)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	// unsigned (x - lo) <= (hi - lo) via min_epu8, letters are case folded first
+	const auto in_range = [](__m128i x, char lo, char span) {
+		const __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+		return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(span)), d);
+	};
+	for (; i + 16 <= n; i += 16) {
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+		const __m128i ok = _mm_or_si128(in_range(x, '0', 9), in_range(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 25));
+		if (const int m = _mm_movemask_epi8(ok) ^ 0xffff)
+			return i + __builtin_ctz(m);
+	}
+#endif
+	for (; i < n; ++i) {
+		const unsigned char c = p[i];
+		if (!((c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')))
+			break;
+	}
+	return i;
+}
+
+size_t Violet::url_decoded_size(const char *src, const size_t len)
+{
+	size_t out = len;
+	for (size_t i = plain_run(src, len, false); i < len; i += 1 + plain_run(src + i + 1, len - i - 1, false))
+		if (i + 2 < len && hex_value(src[i + 1]) >= 0 && hex_value(src[i + 2]) >= 0) {
+			out -= 2;
+			i += 2;
+		}
+	return out;
+}
+
+size_t Violet::url_decode(const char *src, const size_t len, char *dst, bool form_data)
+{
+	const auto start = dst;
+	size_t i = 0;
+	while (i < len) {
+		const size_t run = plain_run(src + i, len - i, form_data);
+		if (dst != src + i)
+			memmove(dst, src + i, run);
+		dst += run;
+		if ((i += run) >= len)
+			break;
+		if (src[i] == '+')
+			*dst++ = ' ';
+		else if (int a, b; i + 2 < len && (a = hex_value(src[i + 1])) >= 0 && (b = hex_value(src[i + 2])) >= 0) {
+			*dst++ = static_cast<char>((a << 4) | b);
+			i += 2;
+		}
+		else *dst++ = '%';
+		++i;
+	}
+	return dst - start;
+}
+
+size_t Violet::url_encoded_size(const char *src, const size_t len, bool keep_reserved)
+{
+	const unsigned char threshold = keep_reserved ? 1 : 2;
+	size_t out = len;
+	for (size_t i = alnum_run(src, len); i < len; i += 1 + alnum_run(src + i + 1, len - i - 1))
+		if (url_encode_table[static_cast<unsigned char>(src[i])] < threshold)
+			out += 2;
+	return out;
+}
+
+size_t Violet::url_encode(const char *src, const size_t len, char *dst, bool keep_reserved)
+{
+	constexpr char hextable[] = "0123456789abcdef";
+	const unsigned char threshold = keep_reserved ? 1 : 2;
+	const auto start = dst;
+	size_t i = 0;
+	while (i < len) {
+		const size_t run = alnum_run(src + i, len - i);
+		memcpy(dst, src + i, run);
+		dst += run;
+		if ((i += run) >= len)
+			break;
+		const unsigned char c = src[i++];
+		if (url_encode_table[c] >= threshold)
+			*dst++ = c;
+		else {
+			*dst++ = '%';
+			*dst++ = hextable[c >> 4];
+			*dst++ = hextable[c & 15];
+		}
+	}
+	return dst - start;
+}
@@ -0,0 +1,68 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <string>
+#include <string_view>
+
+/*
+	Percent-encoding shared by the server and the http client.
+	Runs of characters that pass through untouched are skipped 16 bytes at a time where SSE2 is available,
+	output sizes can be computed up front so nothing is ever appended a char at a time.
+*/
+namespace Violet
+{
+	/* Exact length of the decoded string */
+	size_t url_decoded_size(const char *src, const size_t len);
+
+	/*
+		Decodes into dst which must hold url_decoded_size() bytes, dst == src is allowed.
+		Malformed escapes are copied verbatim, form_data turns '+' into a space.
+		Returns the number of bytes written.
+	*/
+	size_t url_decode(const char *src, const size_t len, char *dst, bool form_data = false);
+
+	inline void url_decode_in_place(std::string &str, bool form_data = false) {
+		str.resize(url_decode(str.data(), str.size(), str.data(), form_data));
+	}
+
+	inline std::string url_decode(std::string_view str, bool form_data = false) {
+		std::string ret(url_decoded_size(str.data(), str.size()), '\0');
+		url_decode(str.data(), str.size(), ret.data(), form_data);
+		return ret;
+	}
+
+	/* Exact length of the encoded string, keep_reserved leaves the RFC 3986 reserved set (and '%') alone */
+	size_t url_encoded_size(const char *src, const size_t len, bool keep_reserved = false);
+
+	/* Encodes into dst which must hold url_encoded_size() bytes, returns the number of bytes written */
+	size_t url_encode(const char *src, const size_t len, char *dst, bool keep_reserved = false);
+
+	inline std::string & url_encode(std::string &out, std::string_view str, bool keep_reserved = false) {
+		const auto old = out.size();
+		out.resize(old + url_encoded_size(str.data(), str.size(), keep_reserved));
+		url_encode(str.data(), str.size(), out.data() + old, keep_reserved);
+		return out;
+	}
+
+	inline std::string url_encode(std::string_view str, bool keep_reserved = false) {
+		std::string ret;
+		return std::move(url_encode(ret, str, keep_reserved));
+	}
+}
@@ -19,6 +19,12 @@
 
 #pragma once
 #include "type.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace Violet::utf8x
 {
@@ -266,23 +272,78 @@ namespace Violet::utf8x
 
 
 
-    template<class Iter>
-    constexpr inline Iter __find_unicode(Iter p, const size_t n, const unsigned cp)
+    /*
+        First byte that is one of the given lead bytes, 32 bytes per step with SSE2.
+        Lead bytes never occur inside a valid sequence, so whatever lies between them needn't be decoded.
+    */
+    template<size_t N>
+    inline const char * __find_lead_byte(const char *p, const char * const e, const std::array<uint8_t, N> &leads, const unsigned count)
     {
+#ifdef __SSE2__
+        __m128i needle[N];
+        for (unsigned i = 0; i < count; ++i)
+            needle[i] = _mm_set1_epi8(static_cast<char>(leads[i]));
+        for (; e - p >= 32; p += 32) {
+            const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)),
+                hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+            __m128i hit_lo = _mm_cmpeq_epi8(lo, needle[0]), hit_hi = _mm_cmpeq_epi8(hi, needle[0]);
+            for (unsigned i = 1; i < count; ++i) {
+                hit_lo = _mm_or_si128(hit_lo, _mm_cmpeq_epi8(lo, needle[i]));
+                hit_hi = _mm_or_si128(hit_hi, _mm_cmpeq_epi8(hi, needle[i]));
+            }
+            if (const unsigned m = static_cast<unsigned>(_mm_movemask_epi8(hit_lo)) | static_cast<unsigned>(_mm_movemask_epi8(hit_hi)) << 16)
+                return p + __builtin_ctz(m);
+        }
+#endif
+        if (count == 1)
+            return p < e ? static_cast<const char *>(std::memchr(p, leads[0], e - p)) : nullptr;
+        for (; p < e; ++p)
+            for (unsigned i = 0; i < count; ++i)
+                if (static_cast<uint8_t>(*p) == leads[i])
+                    return p;
+        return nullptr;
+    }
+
+    template<class A, typename = std::enable_if_t<!std::is_arithmetic_v<A>>>
+    inline const char * __find_unicode_array(const char *p, const size_t n, const A &cp)
+    {
+        using value_type = std::decay_t<decltype(cp[0])>;
+        static_assert(std::is_arithmetic_v<value_type> || std::is_enum_v<value_type>);
         const auto e = p + n;
-        while (p < e) {
+        std::array<uint8_t, 8> leads;
+        unsigned count = 0;
+        for (value_type a : cp) {
+            uint8_t seq[6] = {};
+            put(seq, a);
+            if (std::find(leads.begin(), leads.begin() + count, seq[0]) != leads.begin() + count)
+                continue;
+            if (count == leads.size())
+                return nullptr;    // no marker set is anywhere near this big
+            leads[count++] = seq[0];
+        }
+        if (!count)
+            return nullptr;
+        for (p = __find_lead_byte(p, e, leads, count); p; p = __find_lead_byte(p + 1, e, leads, count)) {
             const auto len = sequence_length(p);
-            if (len < 1 || len > 4 || p + len >= e)
+            if (p + len > e)
                 return nullptr;
-            if (get_switch(p, len) == cp)
-                return p;
-            p += len;
+            if (len <= 4) {
+                const auto val = get_switch(p, len);
+                for (value_type a : cp)
+                    if (val == a)
+                        return p;
+            }
         }
         return nullptr;
     }
 
+    inline const char * __find_unicode(const char *p, const size_t n, const unsigned cp)
+    {
+        return __find_unicode_array(p, n, std::array<unsigned, 1>{ cp });
+    }
+
     template<class Str>
-    constexpr size_t find_unicode(const Str &__s, const unsigned __c, const size_t __pos = 0)
+    inline size_t find_unicode(const Str &__s, const unsigned __c, const size_t __pos = 0)
     {
         const size_t __size = __s.size();
         if (__pos < __size)
@@ -296,32 +357,8 @@ namespace Violet::utf8x
         return Str::npos;
     }
 
-    template<class Iter, class A, typename = std::enable_if_t<!std::is_arithmetic_v<A>>>
-    constexpr inline Iter __find_unicode_array(Iter p, const size_t n, const A &cp)
-    {
-        using value_type = std::decay_t<decltype(cp[0])>;
-        static_assert(std::is_arithmetic_v<value_type> || std::is_enum_v<value_type>);
-        const auto e = p + n;
-        unsigned min_len = 4;
-        for (value_type a : cp)
-            min_len = std::min<unsigned>(min_len, utf8x::code_length(a));
-        while (p < e) {
-            const auto len = sequence_length(p);
-            if (len < 1 || len > 4 || p + len >= e)
-                return nullptr;
-            if (len >= min_len) {
-                const auto val = get_switch(p, len);
-                for (value_type a : cp)
-                    if (val == a)
-                        return p;
-            }
-            p += len;
-        }
-        return nullptr;
-    }
-
     template<class Str, class N, typename = std::enable_if_t<!std::is_arithmetic_v<N>>>
-    constexpr size_t find_unicode_array(const Str &__s, N &&__c, const size_t __pos = 0)
+    inline size_t find_unicode_array(const Str &__s, N &&__c, const size_t __pos = 0)
     {
         const size_t __size = __s.size();
         if (__pos < __size)
@@ -0,0 +1,478 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "app_lifetime.h"
+#include "protocol.hpp"
+#include "file_cache.hpp"
+#include "bluescript.hpp"
+#include "echo/hash.hpp"
+#include "echo/http_date.hpp"
+#include <cinttypes>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <csignal>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+using namespace std::string_view_literals;
+
+/*
+	Touching a page of a mapped file past its current end raises SIGBUS. The handler puts zeros in place
+	of the whole mapping and flags its file, the faulting read then goes on. Only lock-free atomics in here.
+*/
+namespace
+{
+	struct mapping {
+		std::atomic<uintptr_t> begin{ 0 };	// 0 marks a free slot
+		std::atomic<size_t> size{ 0 };
+		std::atomic<std::atomic<bool> *> damaged{ nullptr };
+	};
+	mapping mappings[FILE_CACHE_MAPPING_SLOTS];
+
+	void on_sigbus(int, siginfo_t *info, void *)
+	{
+		const auto at = reinterpret_cast<uintptr_t>(info->si_addr);
+		for (auto &m : mappings)
+			if (const auto begin = m.begin.load(), size = m.size.load(); begin && at - begin < size) {
+				if (const auto d = m.damaged.load())
+					d->store(true);
+				if (mmap(reinterpret_cast<void *>(begin), size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+					return;
+				break;
+			}
+		// not one of ours, the process goes down as it would have
+		signal(SIGBUS, SIG_DFL);
+		raise(SIGBUS);
+	}
+
+	bool handle_sigbus()
+	{
+		static const bool installed = [] {
+			struct sigaction sa {};
+			sa.sa_sigaction = on_sigbus;
+			sa.sa_flags = SA_SIGINFO;
+			sigemptyset(&sa.sa_mask);
+			return sigaction(SIGBUS, &sa, nullptr) == 0;
+		}();
+		return installed;
+	}
+
+	mapping * register_mapping(void * begin, size_t size, std::atomic<bool> &damaged)
+	{
+		for (auto &m : mappings)
+			if (uintptr_t free = 0; m.begin.compare_exchange_strong(free, reinterpret_cast<uintptr_t>(begin))) {
+				m.damaged = &damaged;
+				m.size = size;
+				return &m;
+			}
+		return nullptr;
+	}
+
+	void unregister_mapping(void * begin)
+	{
+		for (auto &m : mappings)
+			if (m.begin.load() == reinterpret_cast<uintptr_t>(begin)) {
+				m.size = 0;
+				m.damaged = nullptr;
+				m.begin = 0;
+				return;
+			}
+	}
+}
+
+bool cached_file::read_from_file(const char* filename, bool map)
+{
+	const int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &attrib) != 0 || !S_ISREG(attrib.st_mode)) {
+		::close(fd);
+		return false;
+	}
+	_size = static_cast<size_type>(attrib.st_size);
+	if (map && _size > FILE_CACHE_MMAP_THRESHOLD && handle_sigbus()) {
+		if (void * m = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0); m != MAP_FAILED) {
+			if (register_mapping(m, _size, _damaged)) {
+				madvise(m, _size, MADV_SEQUENTIAL);
+				_map = m;
+				::close(fd);
+				return true;
+			}
+			munmap(m, _size);	// no slot left, read like a small file
+		}
+	}
+	_data.reset(new value_type[_size]);
+	for (size_type done = 0; done < _size;) {
+		const auto r = ::read(fd, _data.get() + done, _size - done);
+		if (r <= 0) {
+			_size = done;	// truncated under our feet, inotify will bring the rest
+			break;
+		}
+		done += r;
+	}
+	::close(fd);
+	return true;
+}
+
+cached_file::cached_file() = default;
+
+cached_file::~cached_file()
+{
+	if (_map) {
+		unregister_mapping(_map);
+		munmap(_map, _size);
+	}
+}
+
+void cached_file::assign(view_t content)
+{
+	_size = content.size();
+	_data.reset(new value_type[_size]);
+	memcpy(_data.get(), content.data(), _size);
+	memset(&attrib, 0, sizeof(attrib));
+	attrib.st_size = _size;
+	attrib.st_ctime = time(nullptr);
+	Violet::format_http_date(attrib.st_ctime, last_modified);
+	snprintf(content_length, sizeof(content_length), "%zu", _size);
+}
+
+file_cache::file_cache(size_t capacity)
+	: _capacity(capacity)
+{
+#ifdef __linux__
+	_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+file_cache::~file_cache()
+{
+	if (_inotify >= 0)
+		::close(_inotify);
+}
+
+/* The watched directory as events name it, nullptr if it can't be watched */
+const std::string * file_cache::watch(std::string_view dir)
+{
+#ifdef __linux__
+	if (_inotify < 0)
+		return nullptr;
+	if (const auto w = _watched.find(dir); w != _watched.end())
+		return &_watches.find(w->second)->second;
+	// resolved, events have to name files the way the cache keys them whichever spelling found them
+	char * const real = realpath(std::string{ dir }.c_str(), nullptr);
+	if (!real)
+		return nullptr;
+	std::string d{ real };
+	free(real);
+	if (const auto w = _watched.find(d); w != _watched.end())
+		return &_watches.find(w->second)->second;
+	const int wd = inotify_add_watch(_inotify, d.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE
+		| IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+	if (wd < 0)
+		return nullptr;
+	const auto [w, added] = _watches.try_emplace(wd, std::move(d));
+	if (added)
+		_watched.emplace(w->second, wd);
+	return &w->second;
+#else
+	return nullptr;
+#endif
+}
+
+/* Every directory a lookup candidate could appear in has to be watched, or the nearest one that exists */
+bool file_cache::watch_candidates(std::initializer_list<std::string_view> dirs)
+{
+	for (auto d : dirs) {
+		if (d.empty())
+			continue;
+		while (!watch(d)) {
+			if (d == "."sv)
+				return false;
+			const auto slash = d.find_last_of('/');
+			d = slash != std::string_view::npos ? d.substr(0, slash) : "."sv;
+		}
+	}
+	return true;
+}
+
+void file_cache::unindex(std::string_view path, std::list<slot>::iterator it)
+{
+	for (auto [p, end] = _by_path.equal_range(path); p != end; ++p)
+		if (p->second == it) {
+			_by_path.erase(p);
+			break;
+		}
+}
+
+void file_cache::erase(std::list<slot>::iterator it)
+{
+	_used -= it->cost;
+	_mappings -= it->file && it->file->is_mapped();
+	if (it->file) {
+		unindex(it->file->path, it);
+		if (it->file->gzip)
+			unindex(it->file->gzip->path, it);
+	}
+	_index.erase(it->key);
+	_lru.erase(it);
+}
+
+void file_cache::clear()
+{
+	_index.clear();
+	_by_path.clear();
+	_lru.clear();
+	_used = _mappings = 0;
+	++_generation;
+}
+
+void file_cache::drop(std::string_view path)
+{
+	++_generation;
+	for (auto p = _by_path.find(path); p != _by_path.end(); p = _by_path.find(path))
+		erase(p->second);
+}
+
+const file_cache::slot * file_cache::find(std::string_view key)
+{
+	if (const auto it = _index.find(key); it != _index.end()) {
+		if (const auto &f = it->second->file; f && (f->damaged() || (f->gzip && f->gzip->damaged()))) {	// inotify may not have told yet
+			erase(it->second);
+			return nullptr;
+		}
+		_lru.splice(_lru.begin(), _lru, it->second);
+		return &*it->second;
+	}
+	return nullptr;
+}
+
+file_cache::entry_t file_cache::insert(std::string key, std::shared_ptr<cached_file> &&file, std::initializer_list<std::string_view> shadowing)
+{
+	const bool mapped = file->is_mapped();
+	const auto slash = file->path.find_last_of('/');
+	const auto parent = slash != std::string::npos ? std::string_view{ file->path }.substr(0, slash) : "."sv;
+	// mapped pages belong to the page cache, only the bookkeeping is charged for them
+	size_t cost = (mapped ? 0 : file->size()) + key.size() + sizeof(slot);
+	if (cost > _capacity)
+		return std::move(file);	// served plain, it would be read and compressed again on every request
+	// the watches have to exist before the content is trusted, otherwise a change could slip by,
+	// that includes a candidate taking precedence appearing in another directory
+	const auto dir = watch(parent);
+	if (!dir || !watch_candidates(shadowing))
+		return std::move(file);
+	file->path = *dir + (slash != std::string::npos ? file->path.substr(slash) : "/" + file->path);	// as events name it
+	// only what stays gets tagged and compressed, once
+	if (!file->is_html) {
+		tag(*file);
+		precompress(*file, Z_BEST_COMPRESSION);
+		if (file->gzip && !file->gzip->is_mapped())
+			cost += file->gzip->size();
+	}
+	if (cost > _capacity || file->damaged())
+		return std::move(file);
+	while ((_used + cost > _capacity || (mapped && _mappings >= FILE_CACHE_MAX_MAPPINGS)) && !_lru.empty())
+		erase(std::prev(_lru.end()));
+	_lru.push_front({ std::move(key), std::move(file), cost });
+	_index.emplace(_lru.front().key, _lru.begin());
+	_by_path.emplace(_lru.front().file->path, _lru.begin());
+	if (const auto &gz = _lru.front().file->gzip; gz && !gz->path.empty())
+		_by_path.emplace(gz->path, _lru.begin());
+	_used += cost;
+	_mappings += mapped;
+	return _lru.front().file;
+}
+
+void file_cache::insert_missing(std::string key, std::initializer_list<std::string_view> dirs)
+{
+	if (!watch_candidates(dirs))
+		return;
+	const size_t cost = key.size() + sizeof(slot);
+	while (_used + cost > _capacity && !_lru.empty())
+		erase(std::prev(_lru.end()));
+	_lru.push_front({ std::move(key), nullptr, cost });
+	_index.emplace(_lru.front().key, _lru.begin());
+	_used += cost;
+}
+
+std::shared_ptr<cached_file> file_cache::open(std::string path)
+{
+	auto f = std::make_shared<cached_file>();
+	f->mime = &Protocol::mime_types.for_path(path);
+	f->is_html = f->mime->ext == ".html"sv;
+	if (!f->read_from_file(path.c_str(), !f->is_html))
+		return nullptr;
+	f->path = std::move(path);
+	Violet::format_http_date(f->attrib.st_ctime, f->last_modified);
+	snprintf(f->content_length, sizeof(f->content_length), "%zu", f->size());
+	if (f->is_html) {
+		f->program = Blue::compile_file(f->get_string(), f->is_template);
+		f->compiled = Blue::find_compiled(f->path, Violet::xxh64(f->data(), f->size()));
+	}
+	return f;
+}
+
+void file_cache::tag(cached_file &f)
+{
+	snprintf(f.etag, sizeof(f.etag), "\"%016" PRIx64 "\"", Violet::xxh64(f.data(), f.size()));
+}
+
+/* Length of the gzip member header, 0 if it isn't a usable deflate member */
+static size_t gzip_header_size(std::string_view g)
+{
+	if (g.size() < 18 || g[0] != 0x1f || static_cast<unsigned char>(g[1]) != 0x8b || g[2] != Z_DEFLATED)
+		return 0;
+	const unsigned flags = static_cast<unsigned char>(g[3]);
+	size_t p = 10;
+	if (flags & 4)	// FEXTRA
+		p += 2 + (static_cast<unsigned char>(g[p]) | static_cast<unsigned char>(g[p + 1]) << 8);
+	for (unsigned f : { 8u, 16u })	// FNAME, FCOMMENT
+		if (flags & f && p < g.size())
+			if ((p = g.find('\0', p)) != std::string_view::npos)
+				++p;
+	if (p == std::string_view::npos)
+		return 0;
+	if (flags & 2)	// FHCRC
+		p += 2;
+	return p + 8 <= g.size() ? p : 0;
+}
+
+static inline uint32_t read_le32(const char * p)
+{
+	const auto u = reinterpret_cast<const unsigned char *>(p);
+	return u[0] | u[1] << 8 | u[2] << 16 | static_cast<uint32_t>(u[3]) << 24;
+}
+
+void file_cache::precompress(cached_file &f, int level)
+{
+	const auto content = f.get_string();
+	auto gz = std::make_shared<cached_file>();
+	size_t header = 0;
+	// a sibling .gz has to be a single member holding exactly this content, anything else is stale
+	if (std::string fn{ f.path + ".gz" }; !f.path.empty() && gz->read_from_file(fn.c_str())) {
+		const auto g = gz->get_string();
+		if ((header = gzip_header_size(g)) && read_le32(g.data() + g.size() - 4) == static_cast<uint32_t>(content.size())
+				&& read_le32(g.data() + g.size() - 8) == crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef *>(content.data()), content.size())) {
+			gz->path = std::move(fn);
+			snprintf(gz->content_length, sizeof(gz->content_length), "%zu", gz->size());
+		}
+		else header = 0;
+	}
+	if (!header) {
+		if (!Protocol::compression.worth_it(f.mime->type(), content, PRECOMPRESS_MAX_SIZE))
+			return;
+		const auto z = Protocol::compression.compress(content, Violet::encoding::gzip, level);
+		if (z.size() >= content.size() || !(header = gzip_header_size(z.get_string())))
+			return;
+		gz = std::make_shared<cached_file>();
+		gz->assign(z.get_string());
+	}
+	gz->mime = f.mime;
+	// every encoding is a representation of its own, the tags only differ by suffix
+	const int tag = static_cast<int>(strlen(f.etag)) - 1;
+	snprintf(gz->etag, sizeof(gz->etag), "%.*s-gz\"", tag, f.etag);
+	snprintf(f.deflate_etag, sizeof(f.deflate_etag), "%.*s-df\"", tag, f.etag);
+	f.deflate_raw = gz->get_string().substr(header, gz->size() - header - 8);
+	const uint32_t adler = adler32(adler32(0, Z_NULL, 0), reinterpret_cast<const Bytef *>(content.data()), content.size());
+	for (int i = 0; i < 4; ++i)
+		f.zlib_trailer[i] = static_cast<char>(adler >> (24 - 8 * i));
+	snprintf(f.deflate_length, sizeof(f.deflate_length), "%zu", f.deflate_raw.size() + sizeof(f.zlib_header) + sizeof(f.zlib_trailer));
+	f.gzip = std::move(gz);
+}
+
+file_cache::entry_t file_cache::search(std::string_view path, const char * dir)
+{
+	if (auto s = find(path))
+		return s->file;
+	std::string fn, parents[2];
+	int n = 0;
+	for (const char * base : { dir, DIRECTORY_SHARED }) {
+		if (base == nullptr)
+			continue;
+		fn.assign(base).append(path);
+		parents[n++] = fn.substr(0, fn.find_last_of('/'));
+		for (int html = 0; html < 2; ++html, fn += ".html")
+			if (auto f = open(fn); f && !!f->size())	// empty files don't count, as before
+				return insert(std::string{ path }, std::move(f), { parents[0], parents[1] });
+	}
+	insert_missing(std::string{ path }, { parents[0], parents[1] });
+	return nullptr;
+}
+
+file_cache::entry_t file_cache::load(std::string_view path)
+{
+	// '|' keeps these apart from request paths
+	std::string key{ "|" };
+	key += path;
+	if (auto s = find(key); s && s->file)
+		return s->file;
+	if (auto f = open(std::string{ path }))
+		return insert(std::move(key), std::move(f));
+	return nullptr;
+}
+
+bool file_cache::watched(const cached_file &f) const
+{
+	const auto slash = f.path.find_last_of('/');
+	const auto parent = slash != std::string::npos ? std::string_view{ f.path }.substr(0, slash) : "."sv;
+	return _watched.count(parent) > 0;
+}
+
+file_cache::entry_t file_cache::generated(std::string_view content, const mime_type &mime, int level)
+{
+	auto f = std::make_shared<cached_file>();
+	f->assign(content);
+	f->mime = &mime;
+	tag(*f);
+	precompress(*f, level);
+	return f;
+}
+
+void file_cache::poll()
+{
+#ifdef __linux__
+	if (_inotify < 0 || _watches.empty())
+		return;
+	alignas(inotify_event) char buffer[4096];
+	ssize_t len;
+	while ((len = ::read(_inotify, buffer, sizeof(buffer))) > 0)
+		for (ssize_t i = 0; i < len;) {
+			const auto ev = reinterpret_cast<const inotify_event *>(buffer + i);
+			i += sizeof(inotify_event) + ev->len;
+			const auto w = _watches.find(ev->wd);
+			if (ev->mask & IN_IGNORED) {
+				if (w != _watches.end()) {
+					_watched.erase(w->second);
+					_watches.erase(w);
+				}
+				clear();
+			}
+			// a new file may shadow another lookup candidate, cheaper to start over than to work out which
+			else if (w == _watches.end() || ev->mask & (IN_Q_OVERFLOW | IN_CREATE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF))
+				clear();
+			else if (ev->len > 0) {
+				std::string p;
+				if (w->second != "."sv)
+					p.assign(w->second).append(1, '/');
+				drop(p.append(ev->name));
+			}
+		}
+#endif
+}
@@ -18,42 +18,143 @@
 */
 
 #pragma once
+#include <atomic>
 #include <memory>
+#include <string>
 #include <string_view>
-#include "echo/buffers.hpp"
+#include <list>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "mime_types.hpp"
 
+namespace Blue { struct Program; struct Runtime; }
+
+#define FILE_CACHE_CAPACITY (64 << 20)	// heap copies of small files
+#define FILE_CACHE_MMAP_THRESHOLD (64 << 10)	// anything bigger is mapped instead of copied
+#define FILE_CACHE_MAX_MAPPINGS 1024
+#define FILE_CACHE_MAPPING_SLOTS 8192	// mappings alive at once in the whole process, files are read beyond that
+
+// static files are compressed once they're admitted to the cache, sibling .gz files are used as they are
+#define PRECOMPRESS_MAX_SIZE (4 << 20)
+
+/*
+	A file as it is sent, immutable once loaded so responses can hold on to it.
+	Big files are mapped, every connection sending one shares the mapping.
+	A mapped file truncated in place turns into zeros and is flagged damaged instead of taking the server down,
+	transfers queued from it fail and the cache forgets it. Html is always read, programs keep pointing into it.
+*/
 class cached_file
 {
 public:
 	using value_type = char;
 	using view_t = std::basic_string_view<value_type>;
-public:
 	using size_type = std::size_t;
 
+	std::string path;	// resolved on disk
+	struct stat attrib;
+	bool is_html = false, is_template = false;
+	std::unique_ptr<const Blue::Program> program;	// every html file, pages only use it when is_template
+	void (*compiled)(Blue::Runtime &, size_t) = nullptr;	// Blue::Render, the same program built into the binary
+	// precomputed header values
+	const mime_type * mime = &mime_table::plain;
+	char last_modified[32], content_length[24];
+	char etag[24] = "";	// strong, from the content hash, empty for templates
+
+	// precompressed variant, the zlib flavour of deflate reuses the raw stream inside the gzip member
+	std::shared_ptr<const cached_file> gzip;
+	std::string_view deflate_raw;
+	char zlib_trailer[4], deflate_length[24], deflate_etag[24];
+	static constexpr char zlib_header[2] = { 0x78, char(0xda) };
+
 private:
-	std::unique_ptr<value_type[]> data;
-	size_type size = 0;
+	std::unique_ptr<value_type[]> _data;
+	void * _map = nullptr;
+	size_type _size = 0;
+	std::atomic<bool> _damaged{ false };	// set from the SIGBUS handler
 
 public:
-	void clear() {
-		data.reset(nullptr);
-		size = 0;
-	}
-	inline void resize(size_t newlength) {
-		data.reset(new value_type[newlength]); // no memmove, at least for now
-		size = bool(data) ? newlength : 0;
-	}
-
-	inline bool read_from_file(const char* filename) { return Violet::internal::read_from_file(filename, *this); }
-
-	inline view_t get_string() const { return { data.get(), size }; }
-	inline const value_type* data() const { return data.get(); }
-	inline value_type* data() { return data.get(); }
-	inline value_type& operator[](size_type _pos) { return data[_pos]; };
-	inline const value_type& operator[](size_type _pos) const { return data[_pos]; };
-	explicit inline operator value_type *() { return data.get(); }
-	inline operator view_t() { return { data.get(), size }; }
-	inline size_type length() const { return size; }
-	inline size_type size() const { return size; }
-	
-};
\ No newline at end of file
+	cached_file();
+	cached_file(const cached_file &) = delete;
+	cached_file &operator=(const cached_file &) = delete;
+	~cached_file();
+
+	/* Regular files only, stat comes from the same descriptor, big ones are mapped if allowed */
+	bool read_from_file(const char* filename, bool map = true);
+
+	/* Generated content, e.g. a rendered error page */
+	void assign(view_t content);
+
+	inline const value_type* data() const { return _map ? static_cast<const value_type *>(_map) : _data.get(); }
+	inline view_t get_string() const { return { data(), _size }; }
+	inline size_type length() const { return _size; }
+	inline size_type size() const { return _size; }
+	inline bool is_mapped() const { return _map != nullptr; }
+
+	/* The mapped file was cut short, the missing part reads as zeros */
+	inline const std::atomic<bool> &damaged() const { return _damaged; }
+};
+
+/*
+	Per-thread cache of static files, keyed by the lookup that produced them.
+	Directories holding cached files are watched with inotify, poll() applies the changes.
+	Without inotify nothing is cached, stale content is worse than a slow response.
+*/
+class file_cache
+{
+public:
+	using entry_t = std::shared_ptr<const cached_file>;
+
+private:
+	struct slot {
+		std::string key;
+		entry_t file;	// nullptr marks a path known to be missing
+		size_t cost;
+	};
+	std::list<slot> _lru;	// most recently used first
+	std::unordered_map<std::string_view, std::list<slot>::iterator> _index;	// keys point into _lru
+	std::unordered_multimap<std::string_view, std::list<slot>::iterator> _by_path;	// on disk, the file and its .gz sibling
+	const size_t _capacity;
+	size_t _used = 0, _generation = 0, _mappings = 0;
+	int _inotify = -1;
+	std::unordered_map<int, std::string> _watches;	// descriptor -> directory, resolved so every spelling ends up the same
+	std::unordered_map<std::string_view, int> _watched;	// directory -> descriptor, keys point into _watches
+
+	const slot * find(std::string_view key);
+	entry_t insert(std::string key, std::shared_ptr<cached_file> &&file, std::initializer_list<std::string_view> shadowing = {});
+	void insert_missing(std::string key, std::initializer_list<std::string_view> dirs);
+	std::shared_ptr<cached_file> open(std::string path);
+	static void tag(cached_file &file);
+	void precompress(cached_file &file, int level);
+	const std::string * watch(std::string_view dir);
+	bool watch_candidates(std::initializer_list<std::string_view> dirs);
+	void erase(std::list<slot>::iterator it);
+	void unindex(std::string_view path, std::list<slot>::iterator it);
+	void drop(std::string_view path);
+
+public:
+	explicit file_cache(size_t capacity = FILE_CACHE_CAPACITY);
+	~file_cache();
+	file_cache(const file_cache &) = delete;
+	file_cache &operator=(const file_cache &) = delete;
+
+	/* Request path lookup: dir + path, dir + path.html, shared + path, shared + path.html */
+	entry_t search(std::string_view path, const char * dir);
+
+	/* A single file, e.g. html/error.html */
+	entry_t load(std::string_view path);
+
+	/* Generated content to be served like a file (tagged and precompressed), not kept here */
+	entry_t generated(std::string_view content, const mime_type &mime, int level = Z_BEST_COMPRESSION);
+
+	/* Reads pending inotify events, never blocks */
+	void poll();
+
+	void clear();
+
+	/* Bumped whenever anything is invalidated, for results derived from cached files */
+	inline size_t generation() const { return _generation; }
+
+	/* Changes to the file will bump the generation, results derived from it can be kept */
+	bool watched(const cached_file &f) const;
+};
@@ -25,13 +25,11 @@
 using namespace std::string_view_literals;
 using map_t = Protocol::Hi::map_t;
 
-const std::array<unsigned, 5> markers{	// Beware of U+FE0F after some emojis
-	Blue::Codepoints::SuitHeart,
-	Blue::Codepoints::RedHeart,
-	Blue::Codepoints::Tangerine,
-	Blue::Codepoints::Ghost,
-	Blue::Codepoints::CrossMark
-};
+// variables the server sets for templates
+static const Blue::Symbol captcha_seed = Blue::intern("captcha_seed"sv),
+	captcha_image = Blue::intern("captcha_image"sv),
+	session_error = Blue::intern("session_error"sv),
+	register_msg = Blue::intern("register_msg"sv);
 
 inline void GenerateSalt(Violet::UniBuffer &dest, const unsigned _Size = 512u)
 {
@@ -61,143 +59,216 @@ inline bool is_meaningful(A c)
 	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_' || c == '?' || c == '/';
 }
 
+inline std::string include_path(std::string_view name)
+{
+	std::string fn{ Protocol::dir_html };
+	fn += '/';
+	fn += name;
+	fn += ".html";
+	return fn;
+}
+
+inline std::string wrapper_path(std::string_view name)
+{
+	return "html/wrapper_" + std::string(name) + ".html";
+}
+
+// an include skips the whitespace after its flag, which its program still starts with
+inline std::string_view skip_leading_whitespace(std::string_view t)
+{
+	while (!t.empty() && static_cast<unsigned char>(t.front()) < 0x80 && !!std::isspace(static_cast<unsigned char>(t.front())))
+		t.remove_prefix(1);
+	return t;
+}
 
-struct Protocol::Callback
+/* Condition of a block against the value it names */
+bool compare_value(const Blue::TangerineBlock &tb, std::string_view c)
+{
+	if (tb.op == Blue::Operator::none)
+		return true;
+	return std::visit([op = tb.op, c](auto && a) {
+		using value_type = std::decay_t<decltype(a)>;
+		if constexpr (std::is_arithmetic_v<value_type>) {
+			long val;
+			if (Violet::svtonum(c, val, 0) < c.size())
+				switch(op) {
+				case Blue::Operator::equality: return val == a;
+				case Blue::Operator::lessthan: return val < a;
+				case Blue::Operator::greaterthan: return val > a;
+				}
+		}
+		else if (op == Blue::Operator::equality && a == c)
+			return true;
+		return false;
+	}, tb.comp_val);
+}
+
+
+struct Protocol::Callback : Blue::Runtime
 {
 	struct Reusable
 	{
 		Protocol &parent;
-		map_t cb;
+		std::vector<std::optional<std::string>> vars;	// by Blue::Symbol, grows when a template brings new names
+		const Blog::Post * post = nullptr;	// the row of the innermost posts loop
 		const unsigned http_error_code;
+		bool request_dependent = false;	// output varies with the session or request, can't be reused
 
 		Reusable(Protocol &_p, unsigned _hec)
 			: parent(_p), http_error_code(_hec) {}
+
+		std::optional<std::string> &var(Blue::Symbol id) {
+			if (id >= vars.size())
+				vars.resize(id + 1);
+			return vars[id];
+		}
+
+		const std::string * find(Blue::Symbol id) const {
+			return id < vars.size() && vars[id] ? &*vars[id] : nullptr;
+		}
+
+		map_t &list(Blue::Lookup from) {
+			switch (from)
+			{
+			case Blue::Lookup::get: return parent.info.get;
+			case Blue::Lookup::post: return parent.info.post;
+			case Blue::Lookup::cookie: return parent.info.cookie;
+			default: throw std::runtime_error("Null query");
+			}
+		}
+
+		// a column of the row being rendered, or else a request field, null if there's no such field
+		const std::string * field(Blue::Lookup from, Blue::Symbol id, std::string_view key) {
+			if (const auto v = find(id))
+				return v;	// the loop's columns shadow the request lists while it runs
+			if (from == Blue::Lookup::row)
+				throw std::runtime_error("Null query");	// not inside a loop with that name
+			request_dependent = true;
+			const auto &db = list(from);
+			const auto f = db.find(key);
+			return f != db.end() ? &f->second : nullptr;
+		}
 	};
 
 	Reusable & re;
-	Violet::utf8x::translator<char> &uc;
-	size_t read_pos, pos;
-	Violet::UniBuffer &out;
+	rendering &out;
 
-	using wrapped_content_t = std::pair<Violet::UniBuffer, Violet::utf8x::translator<char>>;
-	std::unique_ptr<wrapped_content_t> wrapped_content;
+	// a wrapper takes over the rest of the program, its content marker renders what was left
+	struct rest {
+		const Blue::Program * prog;	// or the compiled one
+		Blue::Render render;
+		size_t ip;
+		bool rendered = false;
+	};
+	file_cache::entry_t wrapper;
+	std::optional<rest> wrapped_content;
+	bool trim = false;	// the first literal of an include loses its leading whitespace
 
-	Callback(Reusable &_re, Violet::utf8x::translator<char> &_u, Violet::UniBuffer &_o)
-		: re(_re), uc(_u), out(_o) { pos = read_pos = uc.get_pos(); }
+	Callback(Reusable &_re, rendering &_o)
+		: re(_re), out(_o) {}
 
-	void magic() {
-		while (true) {
-			pos = uc.find_and_iterate_array(markers);
-			if (pos < uc.size()) {
-				std::visit(*this, Blue::parse(uc));
-			}
-			else {
-				write_remainder();
-				if (bool(wrapped_content) && !wrapped_content->second.is_at_end()) {
-					uc = std::move(wrapped_content->second);
-					wrapped_content.reset();
-				}
-				else break;
-			}
+	void run(const Blue::Program &prog, size_t ip = 0) {
+		while (ip < prog.code.size()) {
+			std::visit(*this, prog.code[ip++]);
+			if (bool(wrapper) && !wrapped_content && apply_wrapper({ &prog, nullptr, ip }))
+				ip = prog.code.size();
 		}
 	}
 
-	// template<class InOutContainer, class ViewT,
-	// 	typename = std::enable_if_t<std::is_same_v<ViewT, typename InOutContainer::view_t>>>
-	// void wrapHTML(InOutContainer &f, const ViewT& wrapper_content, const ViewT& wrapper_title)
-	// {
-	// 	InOutContainer out;
-	// 	Violet::utf8x::translator<char> uc { f.get_string() };
-	// 	const std::array<Blue::Codepoints, 2> hearts { Blue::Codepoints::RedHeart, Blue::Codepoints::SuitHeart };
-		
-	// 	uc.skip_whitespace();
-	// 	size_t read_pos = uc.get_pos();
-	// 	bool found_content = false;
-		
-	// 	while (true) {
-	// 		size_t pos = uc.find_and_iterate_array(hearts);
-	// 		if (pos >= uc.size()) {
-	// 			if (pos > read_pos)
-	// 				out.write(uc.substr(read_pos, pos - read_pos));
-	// 			break;
-	// 		}
-	// 		auto candy = Blue::parse(uc);
-	// 		if (const auto ptr = std::get_if<Blue::HeartFunction>(&candy); ptr && (ptr->key == Blue::Function::Title || ptr->key == Blue::Function::Content)) {
-	// 			if (pos > read_pos)
-	// 				out.write(uc.substr(read_pos, pos - read_pos));
-	// 			if (!uc.is_at_end() && *uc == 0xfe0f)
-	// 				++uc;
-	// 			uc.skip_whitespace();
-	// 			read_pos = uc.get_pos();
-	// 			if (ptr->key == Blue::Function::Title) {
-	// 				out.write(wrapper_title);
-	// 			}
-	// 			else if (!found_content) {
-	// 				out.write(wrapper_content);
-	// 				found_content = true;
-	// 			}
-	// 		}
-	// 	}
-	// 	if (found_content)
-	// 		f.swap(out);
-	// }
-
-	inline void write_remainder() {
-		if (pos > read_pos)
-			out.write(uc.substr(read_pos, pos - read_pos));
-		read_pos = uc.get_pos();
-	}
-
-	void __recursive_stack(Violet::utf8x::translator<char> u, bool check_for_init_tag)
-	{
-		write_remainder();
-		if (check_for_init_tag) {
-			u.skip_whitespace();
-			if (*u != Blue::Codepoints::ChequeredFlag) {
-				out.write(u.substr());
-				return;
-			}
-			(++u).skip_whitespace();
-		}
-		Callback lets_go_deeper(re, u, out);
-		lets_go_deeper.magic();
+	void run(Blue::Render render, size_t ip = 0) {
+		render(*this, ip);
 	}
 
-	void __recursive_stack(Violet::UniBuffer &buff, Blue::HeartFunction &&hf)
-	{
-		write_remainder();
-		Callback lets_go_deeper(re, uc, buff);
-		lets_go_deeper(std::move(hf));
+	/* True if the wrapper rendered the rest */
+	bool apply_wrapper(rest r) {
+		const auto w = std::move(wrapper);
+		wrapped_content.emplace(r);
+		if (w->compiled)
+			run(w->compiled);
+		else
+			run(*w->program);
+		const bool rendered = wrapped_content->rendered;
+		wrapped_content.reset();
+		return rendered;
 	}
 
-	void __recursive_stack_ref(Violet::utf8x::translator<char> &u)
-	{
-		write_remainder();
-		Callback lets_go_deeper(re, u, out);
-		lets_go_deeper.magic();
+	void lets_go_deeper(const Blue::Program &prog, size_t ip = 0) {
+		Callback deeper(re, out);
+		deeper.run(prog, ip);
+	}
+
+	void lets_go_deeper(Blue::Render render, size_t ip = 0) {
+		Callback deeper(re, out);
+		deeper.run(render, ip);
+	}
+
+	void include(const cached_file &f) {
+		Callback deeper(re, out);
+		deeper.trim = true;
+		if (f.compiled)
+			deeper.run(f.compiled);
+		else
+			deeper.run(*f.program);
+	}
+
+	// what compiled templates call, everything goes through the same code as the interpreter
+
+	void text(std::string_view t) override {
+		(*this)(t);
+	}
+
+	void escape(unsigned int val) override {
+		(*this)(Blue::StrategicEscape{ val });
+	}
+
+	void fail(const char * what) override {
+		throw std::runtime_error(what);
+	}
+
+	void branch(const Blue::TangerineBlock &test, Blue::Render then, Blue::Render otherwise) override {
+		trim = false;
+		if (passes(test))
+			lets_go_deeper(then);
+		else if (otherwise)
+			lets_go_deeper(otherwise);
 	}
 
-	void operator()(Blue::HeartFunction &&hf) {
-		write_remainder(); // has to be written whether or not function outputs anything 
+	void loop(const Blue::CherryBlock &rows, Blue::Render body, Blue::Render otherwise) override {
+		trim = false;
+		if (!each_row(rows, [&] { lets_go_deeper(body); }) && otherwise)
+			lets_go_deeper(otherwise);
+	}
+
+	bool call(const Blue::HeartFunction &hf, Blue::Render self, size_t next) override {
+		(*this)(hf);
+		return bool(wrapper) && !wrapped_content && apply_wrapper({ nullptr, self, next });
+	}
+
+	void operator()(const Blue::HeartFunction &hf) {
+		trim = false;
 		switch (hf.key)
 		{
 		case Blue::Function::Echo:
-			if (hf.arg.size() == 1 || hf.arg.size() == 2) {
-					const auto& db = hf.arg.size() == 2 ? re.parent.info.list(hf.arg[0]) : re.cb;
-					if (auto a = db.find(hf.arg[hf.arg.size() - 1]); a != db.end())
-						out << a->second;
+			if (hf.arg.size() == 1) {
+				if (const auto v = re.find(hf.var))
+					out << *v;
+			}
+			else if (hf.arg.size() == 2) {
+				if (const auto v = re.field(hf.from, hf.var, hf.arg[1]))
+					out << *v;
 			}
 			break;
 
 		case Blue::Function::Constant:
 			if (hf.arg.size() == 1 && bool(hf.chain)) {
-				Violet::UniBuffer tbuff;
-				__recursive_stack(tbuff, std::move(*hf.chain));
-				hf.chain.release();
-				re.cb[std::string(hf.arg[0])] = std::string(tbuff.get_string());
+				rendering tbuff;
+				Callback deeper(re, tbuff);
+				deeper(*hf.chain);
+				re.var(hf.var) = tbuff.str();
+				return;	// the chain went into the constant
 			}
 			else if (hf.arg.size() == 2) {
-				re.cb[std::string(hf.arg[0])] = std::string(hf.arg[1]);
+				re.var(hf.var) = std::string(hf.arg[1]);
 			}
 			break;
 
@@ -222,9 +293,15 @@ struct Protocol::Callback
 				case 405:
 					out.write("Method Not Allowed"sv);
 					break;
+				case 413:
+					out.write("Payload Too Large"sv);
+					break;
 				case 416:
 					out.write("Requested Range Not Satisfiable"sv);
 					break;
+				case 417:
+					out.write("Expectation Failed"sv);
+					break;
 				case 501:
 					out.write("Not Implemented"sv);
 					break;
@@ -243,51 +320,54 @@ struct Protocol::Callback
 		case Blue::Function::Include:
 			if (hf.arg.size() == 1)
 			{
-				std::string fn{ dir_html };
-				fn += '/';
-				fn += hf.arg[0];
-				fn += ".html";
-				Violet::UniBuffer t;
-				if (t.read_from_file(fn.c_str())) {
-					__recursive_stack(t.get_string(), true);
+				if (const auto f = re.parent.shared.files.load(include_path(hf.arg[0])); f && f->program) {
+					out.hold(f);	// the cache may let go of it before the output is sent
+					if (f->is_template)
+						include(*f);
+					else {
+						Violet::utf8x::translator<char> u{ f->get_string() };
+						u.skip_whitespace();
+						out.refer(u.substr());
+					}
 				}
 			}
 			break;
 			
 		case Blue::Function::Wrapper:
-			if ((hf.arg.size() == 1 || hf.arg.size() == 2) && !bool(wrapped_content)) {
-				Violet::UniBuffer t;
-				const std::string fn{ "html/wrapper_" + std::string(hf.arg[0]) + ".html" };
-				if (t.read_from_file(fn.c_str())) {
-					Violet::utf8x::translator<char> uc_copy(uc);
-					wrapped_content = std::make_unique<wrapped_content_t>(std::move(t), std::move(uc));
-					uc = wrapped_content->first.get_string();
-					uc.skip_whitespace();
+			if ((hf.arg.size() == 1 || hf.arg.size() == 2) && !wrapped_content && !wrapper) {
+				if (auto f = re.parent.shared.files.load(wrapper_path(hf.arg[0])); f && f->program) {
+					out.hold(f);
+					wrapper = std::move(f);	// applied by run() once this function is done
 				}
 			}
 			break;
 
 		case Blue::Function::Content:
-			if (bool(wrapped_content)) {
-				if (!wrapped_content->second.is_at_end())
-					__recursive_stack_ref(wrapped_content->second);
+			if (wrapped_content && !wrapped_content->rendered) {
+				wrapped_content->rendered = true;
+				if (wrapped_content->render)
+					lets_go_deeper(wrapped_content->render, wrapped_content->ip);
+				else if (wrapped_content->ip < wrapped_content->prog->code.size())
+					lets_go_deeper(*wrapped_content->prog, wrapped_content->ip);
 			}
 			break;
 
 		case Blue::Function::GenerateCaptcha:
+			re.request_dependent = true;
 			if (!hf.arg.size())
 			{
 				Captcha::Init c;
 				c.set_up(true);
 				
-				re.cb["captcha_seed"] = std::move(c.seed);
-				re.cb["captcha_image"] = "/captcha." + c.Imt.PicFilename;	// this one is moved in the next step
+				re.var(captcha_seed) = std::move(c.seed);
+				re.var(captcha_image) = "/captcha." + c.Imt.PicFilename;	// this one is moved in the next step
 				c.Imt.Data = std::async(std::launch::async, Captcha::Image::process, c.Imt.Collection);
 				re.parent.shared.captcha_sig.emplace_back(std::move(c.Imt), std::chrono::system_clock::now());
 			}
 			break;
 
 		case Blue::Function::StartSession:
+			re.request_dependent = true;
 			if (const auto argc = hf.arg.size(); argc > 1 && re.parent.ss == nullptr && re.parent.shared.dir_accounts)
 			{
 				//const size_t count = tag.GetObjCount();
@@ -314,7 +394,7 @@ struct Protocol::Callback
 						data[0].resize(data[0].length() - 1);
 					auto ct = std::remove_if(data[0].begin(), data[0].end(), [](char c) { return (c == '\"' || c == '\''); });
 					data[0].erase(ct, data[0].end());
-					re.cb[static_cast<std::string>(hf.arg[0])] = data[0];
+					re.var(hf.var) = data[0];
 					{
 						auto e = std::find_if(data[0].begin(), data[0].end(), [&](char c) { return !is_username_acceptable(c); });
 						if (e != data[0].end())
@@ -373,7 +453,7 @@ struct Protocol::Callback
 					break;
 				}
 				if (!!error_msg.length())
-					re.cb["session_error"] = std::move(error_msg);
+					re.var(session_error) = std::move(error_msg);
 				
 				if (!!data.size()) {
 #ifndef WRITE_DATES_ONLY_ON_HEADERS
@@ -393,6 +473,7 @@ struct Protocol::Callback
 			break;
 
 		case Blue::Function::KillSession:
+			re.request_dependent = true;
 			if (!hf.arg.size() && re.parent.ss != nullptr)
 			{
 				std::string name;
@@ -422,6 +503,7 @@ struct Protocol::Callback
 			break;
 
 		case Blue::Function::Register:
+			re.request_dependent = true;
 			if (const auto argc = hf.arg.size(); argc == 6 && re.parent.ss == nullptr && re.parent.shared.dir_accounts)
 			{
 				std::string error_msg;
@@ -444,8 +526,8 @@ struct Protocol::Callback
 					data[0].erase(ct, data[0].end());
 					ct = std::remove_if(data[3].begin(), data[3].end(), has_quotes);
 					data[3].erase(ct, data[3].end());
-					re.cb[static_cast<std::string>(hf.arg[0])] = data[0];
-					re.cb[static_cast<std::string>(hf.arg[3])] = data[3];
+					re.var(hf.var) = data[0];
+					re.var(Blue::intern(hf.arg[3])) = data[3];
 					if (!ok) break;
 					else {
 						std::string dir(dir_work);
@@ -488,7 +570,7 @@ struct Protocol::Callback
 							w.write<std::chrono::microseconds::rep>( 0x0 );
 							w.write_to_file((dir + USERFILE_LASTLOGIN).c_str());
 
-							re.cb["register_msg"] = "Account `<strong>" + data[0] + "</strong>` has been created.";
+							re.var(register_msg) = "Account `<strong>" + data[0] + "</strong>` has been created.";
 
 							re.parent.CreateSession(data[0], nullptr);
 
@@ -502,11 +584,12 @@ struct Protocol::Callback
 					}
 				}
 				if (error_msg.length())
-					re.cb["session_error"] = std::move(error_msg);
+					re.var(session_error) = std::move(error_msg);
 			}
 			break;
 
 		case Blue::Function::SessionInfo:
+			re.request_dependent = true;
 			if (re.parent.ss != nullptr && hf.arg.size() == 1)
 			{
 				if (hf.arg[0] == "name")
@@ -519,125 +602,702 @@ struct Protocol::Callback
 		}
 
 		if (bool(hf.chain)) {
-			this->operator()(std::move(*hf.chain));
+			this->operator()(*hf.chain);
 		}
 	}
 
-	void operator()(Blue::TangerineBlock &&tb) {
-		bool skip = true;
+	bool passes(const Blue::TangerineBlock &tb) {
+		switch (tb.from)
+		{
+		case Blue::Lookup::session:
+			re.request_dependent = true;
+			return re.parent.ss != nullptr;
 
-		do {
-			if (tb.sub.empty()) {
-				if (tb.name == "Session") {
-					if (re.parent.ss != nullptr)
-						skip = false;
-					break;
-				}
-				else if (tb.name == "NoSession") {
-					if (re.parent.ss == nullptr)
-						skip = false;
-					break;
+		case Blue::Lookup::no_session:
+			re.request_dependent = true;
+			return re.parent.ss == nullptr;
+
+		case Blue::Lookup::userlevel:
+			re.request_dependent = true;
+			if (re.parent.ss == nullptr)
+				return false;
+			if (tb.op == Blue::Operator::none)
+				return true;
+			if (auto val = std::get_if<long>(&tb.comp_val))
+				switch(tb.op) {
+					case Blue::Operator::equality: return re.parent.ss->userlevel == *val;
+					case Blue::Operator::lessthan: return re.parent.ss->userlevel < *val;
+					case Blue::Operator::greaterthan: return re.parent.ss->userlevel > *val;
+					default: break;
 				}
-				else if (tb.name == "Userlevel") {
-					if (re.parent.ss != nullptr) {
-						if (tb.op == Blue::Operator::none)
-							skip = false;
-						else
-							if (auto val = std::get_if<long>(&tb.comp_val))
-								switch(tb.op) {
-									case Blue::Operator::equality: skip = !(re.parent.ss->userlevel == *val); break;
-									case Blue::Operator::lessthan: skip = !(re.parent.ss->userlevel < *val); break;
-									case Blue::Operator::greaterthan: skip = !(re.parent.ss->userlevel > *val); break;
-								}
-					}
-					break;
+			return false;
+
+		case Blue::Lookup::variable:
+			if (const auto v = re.find(tb.var))
+				return compare_value(tb, *v);
+			return false;
+
+		default:
+			if (const auto v = re.field(tb.from, tb.var, tb.sub))
+				return compare_value(tb, *v);
+			return false;
+		}
+	}
+
+	void operator()(const Blue::Branch &br) {
+		trim = false;
+		if (passes(br.test))
+			lets_go_deeper(*br.then);
+		else if (bool(br.otherwise))
+			lets_go_deeper(*br.otherwise);
+	}
+
+	/* Sets the columns for each row and renders the body, they get back what they had before when it's done */
+	template<class Body>
+	size_t each_row(const Blue::CherryBlock &cb, Body &&body) {
+		std::vector<std::optional<std::string>> saved;
+		saved.reserve(cb.columns.size());
+		for (const auto id : cb.columns)
+			saved.emplace_back(std::move(re.var(id)));
+		size_t count = 0;
+		const auto row = [&](std::initializer_list<std::string_view> values) {
+			auto id = cb.columns.begin();
+			for (const auto v : values)
+				re.var(*id++) = v;
+			body();
+			++count;
+		};
+
+		switch (cb.rows)
+		{
+		case Blue::Rows::posts: {
+			const auto outer = re.post;
+			for (const auto &blog : re.parent.shared.active_blogs)
+				for (const auto &p : blog.posts) {
+					char date[16];
+					std::strftime(date, sizeof(date), "%Y-%m-%d", &p.date);
+					re.post = &p;
+					row({ p.title, p.content, date, blog.title });
 				}
+			re.post = outer;
+			break;
+		}
+
+		case Blue::Rows::tags:
+			if (re.post != nullptr) {
+				for (const auto &t : re.post->tags)
+					row({ t });
+			}
+			else {
+				std::vector<std::string_view> all;	// of every post, once each
+				for (const auto &blog : re.parent.shared.active_blogs)
+					for (const auto &p : blog.posts)
+						all.insert(all.end(), p.tags.begin(), p.tags.end());
+				std::sort(all.begin(), all.end());
+				all.erase(std::unique(all.begin(), all.end()), all.end());
+				for (const auto t : all)
+					row({ t });
 			}
+			break;
 
-			{
-				const auto& db = tb.sub.empty() ? re.cb : re.parent.info.list(tb.name);
-				if (auto g = db.find(tb.sub.empty() ? tb.name : tb.sub); g != db.end())
-				{
-					if (tb.op == Blue::Operator::none) {
-						skip = false;
-					}
-					else skip = !std::visit([op = tb.op, &c = g->second](auto && a) {
-						using value_type = std::decay_t<decltype(a)>;
-						if constexpr (std::is_arithmetic_v<value_type>) {
-							long val;
-							if (Violet::svtonum(c, val, 0) < c.size())
-								switch(op) {
-								case Blue::Operator::equality: return val == a;
-								case Blue::Operator::lessthan: return val < a;
-								case Blue::Operator::greaterthan: return val > a;
-								}
-						}
-						else if (op == Blue::Operator::equality && a == c)
-							return true;
-						return false;
-					}, tb.comp_val);
-				}
+		case Blue::Rows::get:
+		case Blue::Rows::post:
+		case Blue::Rows::cookie:
+			re.request_dependent = true;
+			for (const auto &[key, value] : re.list(cb.rows == Blue::Rows::get ? Blue::Lookup::get : cb.rows == Blue::Rows::post ? Blue::Lookup::post : Blue::Lookup::cookie))
+				row({ key, value });
+			break;
+
+		case Blue::Rows::session:
+			re.request_dependent = true;
+			if (re.parent.ss != nullptr)
+				row({ re.parent.ss->username, std::to_string(re.parent.ss->userlevel) });
+			break;
+
+		default:
+			break;
+		}
+
+		for (size_t i = 0; i < saved.size(); ++i)
+			re.var(cb.columns[i]) = std::move(saved[i]);
+		return count;
+	}
+
+	void operator()(const Blue::Loop &lp) {
+		trim = false;
+		if (!each_row(lp.rows, [&] { lets_go_deeper(*lp.body); }) && bool(lp.otherwise))
+			lets_go_deeper(*lp.otherwise);
+	}
+
+	void operator()(const std::string_view &text) {
+		out.refer(trim ? skip_leading_whitespace(text) : text);
+		trim = false;
+	}
+
+	void operator()(const Blue::StrategicEscape &se) {
+		trim = false;
+		out.write_utfx(se.val);
+	}
+
+	void operator()(const Blue::ParseError &e) {
+		throw std::runtime_error(e.what);
+	}
+};
+
+/*
+	Partial evaluation: Callback::run over everything that renders the same for every request.
+	A constant is known while every run agrees on its value, whatever can't be decided is emitted for later.
+	Includes and wrappers are folded in, the output never depends on which Callback runs it.
+*/
+struct Fold
+{
+	Protocol::Shared &shared;
+	Blue::Program &root;	// owns the text, keeps the sources alive
+	std::map<Blue::Symbol, std::string_view> known;
+	unsigned depth = 0;
+	bool halted = false;	// a parse error ends every rendering there
+	bool untracked = false;	// something folded in could change without a new files.generation()
+
+	using wrapped_t = std::pair<const Blue::Program *, size_t>;
+
+	struct emitter {
+		Fold &f;
+		std::vector<Blue::Instruction> code;
+		std::string pending;	// adjacent text is merged
+
+		void text(std::string_view t) { pending += t; }
+
+		void flush() {
+			if (!pending.empty()) {
+				code.emplace_back(std::in_place_type<std::string_view>, f.root.text.emplace_back(std::move(pending)));
+				pending.clear();
 			}
 		}
-		while (false);
 
-		if (skip) {
-			write_remainder();
-			if (bool(tb.elseblock)) {
-				if (auto strawberry = std::get_if<std::string_view>(tb.elseblock.get())) {
-					__recursive_stack(*strawberry, false);
-				}
-				else if (auto lemon = std::get_if<Blue::TangerineBlock>(tb.elseblock.get())) {
-					this->operator()(std::move(*lemon));
-				}
+		template<class I>
+		void emit(I &&i) {
+			flush();
+			code.emplace_back(std::forward<I>(i));
+		}
+
+		std::unique_ptr<const Blue::Program> finish() {
+			flush();
+			auto p = std::make_unique<Blue::Program>();
+			p->code = std::move(code);
+			return p;
+		}
+	};
+
+	static Blue::HeartFunction copy(const Blue::HeartFunction &hf, bool with_chain = false) {
+		Blue::HeartFunction c{ hf.key };
+		c.arg = hf.arg;
+		c.from = hf.from;
+		c.var = hf.var;
+		if (with_chain && bool(hf.chain))
+			c.chain = std::make_unique<Blue::HeartFunction>(copy(*hf.chain, true));
+		return c;
+	}
+
+	// nothing but text and constants, which are accounted for in known
+	static bool is_text(const Blue::Instruction &i) {
+		if (auto hf = std::get_if<Blue::HeartFunction>(&i))
+			return hf->key == Blue::Function::Constant && hf->arg.size() == 2 && !hf->chain;
+		return std::holds_alternative<std::string_view>(i);
+	}
+
+	void run(emitter &em, const Blue::Program &prog, size_t ip = 0) {
+		wrapped_t wc{ nullptr, 0 };
+		run(em, wc, prog, ip);
+	}
+
+	void run(emitter &em, wrapped_t &wc, const Blue::Program &prog, size_t ip) {
+		while (ip < prog.code.size() && !halted) {
+			file_cache::entry_t wrapper;
+			std::visit([&](const auto &i) { step(em, wc, wrapper, i); }, prog.code[ip++]);
+			if (bool(wrapper) && !halted) {
+				wc = { &prog, ip };
+				run(em, wc, *wrapper->program, 0);
+				ip = wc.second;
+				wc = { nullptr, 0 };
 			}
 		}
-		else {
-			__recursive_stack(tb.content, false);
+	}
+
+	void include(emitter &em, const Blue::Program &prog) {
+		size_t ip = 0;
+		if (auto text = prog.code.empty() ? nullptr : std::get_if<std::string_view>(&prog.code.front())) {
+			em.text(skip_leading_whitespace(*text));
+			ip = 1;
 		}
+		run(em, prog, ip);
 	}
 
-	void operator()(Blue::StrategicEscape &&se) {
-		write_remainder();
-		out.write_utfx(se.val);
+	// a body that may or may not run, folded on its own
+	std::unique_ptr<const Blue::Program> apart(const Blue::Program &prog) {
+		emitter sub{ *this };
+		const bool was_halted = halted;
+		run(sub, prog);
+		halted = was_halted;
+		return sub.finish();
 	}
 
-	void operator()(bool keep_body) {
-		if (keep_body) {
-			pos = uc.get_pos();
+	file_cache::entry_t load(const std::string &fn) {
+		auto f = shared.files.load(fn);
+		if (f && f->program) {
+			untracked |= !shared.files.watched(*f);
+			root.sources.emplace_back(f);
+			return f;
 		}
-		else {
-			write_remainder();
+		return nullptr;
+	}
+
+	void step(emitter &em, wrapped_t &, file_cache::entry_t &, const std::string_view &text) {
+		em.text(text);
+	}
+
+	void step(emitter &em, wrapped_t &, file_cache::entry_t &, const Blue::StrategicEscape &se) {
+		char seq[6];
+		const auto n = Violet::utf8x::code_length(se.val);
+		Violet::utf8x::put_switch(seq, n, se.val);
+		em.text({ seq, n });
+	}
+
+	void step(emitter &em, wrapped_t &, file_cache::entry_t &, const Blue::ParseError &e) {
+		em.emit(Blue::ParseError{ e.what });
+		halted = true;
+	}
+
+	void step(emitter &em, wrapped_t &, file_cache::entry_t &, const Blue::Branch &br) {
+		const auto &tb = br.test;
+		if (tb.from == Blue::Lookup::variable)
+			if (const auto k = known.find(tb.var); k != known.end()) {
+				if (compare_value(tb, k->second))
+					run(em, *br.then);
+				else if (bool(br.otherwise))
+					run(em, *br.otherwise);
+				return;
+			}
+		Blue::Branch out;
+		out.test.name = tb.name;
+		out.test.sub = tb.sub;
+		out.test.content = tb.content;
+		out.test.op = tb.op;
+		out.test.comp_val = tb.comp_val;
+		out.test.from = tb.from;
+		out.test.var = tb.var;
+		const auto before = known;
+		out.then = apart(*br.then);
+		const auto after_then = std::move(known);
+		known = before;
+		if (bool(br.otherwise))
+			out.otherwise = apart(*br.otherwise);
+		// only what both ways agree on is still known
+		for (auto it = known.begin(); it != known.end();)
+			if (const auto t = after_then.find(it->first); t == after_then.end() || t->second != it->second)
+				it = known.erase(it);
+			else
+				++it;
+		em.emit(std::move(out));
+	}
+
+	void step(emitter &em, wrapped_t &, file_cache::entry_t &, const Blue::Loop &lp) {
+		// the bodies run any number of times, nothing set in or before them can be relied on
+		Blue::Loop out;
+		out.rows = lp.rows;
+		known.clear();
+		out.body = apart(*lp.body);
+		known.clear();
+		if (bool(lp.otherwise))
+			out.otherwise = apart(*lp.otherwise);
+		known.clear();
+		em.emit(std::move(out));
+	}
+
+	void step(emitter &em, wrapped_t &wc, file_cache::entry_t &wrapper, const Blue::HeartFunction &hf) {
+		switch (hf.key)
+		{
+		case Blue::Function::Echo:
+			if (hf.arg.size() == 1) {
+				if (const auto k = known.find(hf.var); k != known.end())
+					em.text(k->second);
+				else
+					em.emit(copy(hf));
+			}
+			else if (hf.arg.size() == 2)
+				em.emit(copy(hf));
+			break;
+
+		case Blue::Function::Constant:
+			if (hf.arg.size() == 1 && bool(hf.chain)) {
+				emitter sub{ *this };
+				wrapped_t none{ nullptr, 0 };
+				file_cache::entry_t no_wrapper;
+				step(sub, none, no_wrapper, *hf.chain);
+				sub.flush();
+				if (std::all_of(sub.code.begin(), sub.code.end(), is_text)) {
+					std::string value;
+					for (auto &i : sub.code)
+						if (auto text = std::get_if<std::string_view>(&i))
+							value += *text;
+						else
+							em.emit(std::move(i));
+					Blue::HeartFunction c{ Blue::Function::Constant };
+					c.arg = { hf.arg[0], root.text.emplace_back(std::move(value)) };
+					c.var = hf.var;
+					known[hf.var] = c.arg[1];
+					em.emit(std::move(c));
+				}
+				else {
+					known.erase(hf.var);
+					em.emit(copy(hf, true));
+				}
+				return;	// the chain went into the constant
+			}
+			else if (hf.arg.size() == 2) {
+				known[hf.var] = hf.arg[1];
+				em.emit(copy(hf));
+			}
+			break;
+
+		case Blue::Function::StatusErrorCode:
+		case Blue::Function::StatusErrorText:
+		case Blue::Function::KillSession:
+		case Blue::Function::SessionInfo:
+			em.emit(copy(hf));
+			break;
+
+		case Blue::Function::GenerateCaptcha:
+		case Blue::Function::StartSession:
+		case Blue::Function::Register:
+			em.emit(copy(hf));
+			known.clear();	// these set constants of their own
+			break;
+
+		case Blue::Function::Copyright:
+			em.text(shared.var_copyright);
+			break;
+
+		case Blue::Function::Battery:
+			break;
+
+		case Blue::Function::Include:
+			if (hf.arg.size() == 1) {
+				if (depth >= MAX_FOLDED_INCLUDE_DEPTH) {
+					em.emit(copy(hf));
+					known.clear();
+				}
+				else if (const auto f = load(include_path(hf.arg[0]))) {
+					if (f->is_template) {
+						++depth;
+						include(em, *f->program);
+						--depth;
+					}
+					else {
+						Violet::utf8x::translator<char> u{ f->get_string() };
+						u.skip_whitespace();
+						em.text(u.substr());
+					}
+				}
+			}
+			break;
+
+		case Blue::Function::Wrapper:
+			if ((hf.arg.size() == 1 || hf.arg.size() == 2) && !wc.first && !wrapper)
+				wrapper = load(wrapper_path(hf.arg[0]));
+			break;
+
+		case Blue::Function::Content:
+			if (wc.first && wc.second < wc.first->code.size()) {
+				run(em, *wc.first, wc.second);
+				wc.second = wc.first->code.size();
+			}
+			break;
+
+		default:
+			em.text(u8"❤️"sv);
 		}
+
+		if (bool(hf.chain))
+			step(em, wc, wrapper, *hf.chain);
 	}
 };
 
+static void collect_inputs(const Blue::Program &prog, Protocol::Page::Inputs &in, Protocol::Shared *files, unsigned depth);
 
+/*
+	Collects what a folded program reads from the request, and clears what it rules out.
+	A program that wasn't folded (compiled ahead of time) has its includes and wrappers looked up in files.
+*/
+static void collect_inputs(const Blue::HeartFunction &hf, Protocol::Page::Inputs &in, Protocol::Shared *files, unsigned depth)
+{
+	switch (hf.key)
+	{
+	case Blue::Function::Echo:
+		if (hf.arg.size() == 2 && hf.from != Blue::Lookup::row)
+			in.fields.emplace_back(hf.from, hf.arg[1]);
+		break;
 
+	case Blue::Function::StatusErrorCode:
+	case Blue::Function::StatusErrorText:
+		in.error = true;
+		break;
 
-std::optional<Violet::UniBuffer> Protocol::HandleHTML(const std::string_view &h, uint16_t error)
-{
-	Violet::utf8x::translator<char> uc { h };
+	case Blue::Function::SessionInfo:
+		in.session = in.username = true;
+		break;
 
-	uc.skip_whitespace();
-	if (uc.get_and_iterate() == Blue::Codepoints::ChequeredFlag)
-	{
-		Violet::UniBuffer output;
-		Callback::Reusable re(*this, error);
-		Callback call(re, uc, output);
-		output.write(std::array<unsigned char, 3>{ 0xef, 0xbb, 0xbf });
+	case Blue::Function::Constant:
+	case Blue::Function::Content:
+	case Blue::Function::Copyright:
+	case Blue::Function::Battery:
+		break;
+
+	case Blue::Function::GenerateCaptcha:
+		in.cacheable = false;
+		break;
+
+	case Blue::Function::Include:
+	case Blue::Function::Wrapper:
+		if (files && depth < MAX_FOLDED_INCLUDE_DEPTH && !hf.arg.empty()) {
+			const auto f = files->files.load(hf.key == Blue::Function::Include ? include_path(hf.arg[0]) : wrapper_path(hf.arg[0]));
+			if (f && f->program && !files->files.watched(*f))
+				in.cacheable = false;	// nothing would say when it changes
+			if (f && f->program && (f->is_template || hf.key == Blue::Function::Wrapper))
+				collect_inputs(*f->program, in, files, depth + 1);
+			break;
+		}
+		[[fallthrough]];
+
+	default:	// sessions set cookies, includes past the fold could do anything
+		in.cacheable = in.streamable = false;
+	}
+	if (bool(hf.chain))
+		collect_inputs(*hf.chain, in, files, depth);
+}
 
-		try {
-			call.magic();
+static void collect_inputs(const Blue::Program &prog, Protocol::Page::Inputs &in, Protocol::Shared *files = nullptr, unsigned depth = 0)
+{
+	for (const auto &i : prog.code)
+		if (auto hf = std::get_if<Blue::HeartFunction>(&i))
+			collect_inputs(*hf, in, files, depth);
+		else if (auto br = std::get_if<Blue::Branch>(&i)) {
+			const auto &tb = br->test;
+			switch (tb.from)
+			{
+			case Blue::Lookup::variable:
+			case Blue::Lookup::row: break;
+			case Blue::Lookup::session:
+			case Blue::Lookup::no_session: in.session = true; break;
+			case Blue::Lookup::userlevel: in.session = in.userlevel = true; break;
+			default: in.fields.emplace_back(tb.from, tb.sub);
+			}
+			collect_inputs(*br->then, in, files, depth);
+			if (bool(br->otherwise))
+				collect_inputs(*br->otherwise, in, files, depth);
 		}
-		catch (std::exception &e) {
-			output << char('\n') << e.what();
+		else if (auto lp = std::get_if<Blue::Loop>(&i)) {
+			switch (lp->rows.rows)
+			{
+			case Blue::Rows::get:
+			case Blue::Rows::post:
+			case Blue::Rows::cookie: in.cacheable = false; break;	// every field, not a few
+			case Blue::Rows::session: in.session = in.userlevel = in.username = true; break;
+			default: break;
+			}
+			collect_inputs(*lp->body, in, files, depth);
+			if (bool(lp->otherwise))
+				collect_inputs(*lp->otherwise, in, files, depth);
 		}
-		catch (...) {
-			output << "\nSomething went horribly awry ;("sv;
+		else if (std::holds_alternative<Blue::ParseError>(i))
+			in.cacheable = false;
+}
+
+std::shared_ptr<const Protocol::Page> Protocol::PreparePage(const file_cache::entry_t &src)
+{
+	if (shared.pages_generation != shared.files.generation() || shared.pages.size() >= MAX_PREPARED_PAGES) {
+		shared.pages.clear();
+		shared.pages_generation = shared.files.generation();
+	}
+	if (const auto p = shared.pages.find(src.get()); p != shared.pages.end())
+		return p->second;
+
+	auto page = std::make_shared<Page>();
+	page->source = src;
+	if (src->compiled) {
+		// compiled ahead of time, it's run as it is instead of being folded
+		page->program = std::shared_ptr<const Blue::Program>(src, src->program.get());
+		page->compiled = src->compiled;
+		if (shared.files.watched(*src)) {
+			page->inputs.cacheable = page->inputs.streamable = true;
+			collect_inputs(*src->program, page->inputs, &shared);
+			shared.pages.emplace(src.get(), page);
 		}
-		if (output.size() > 3)
-			return output;
+		return page;
+	}
+	auto prog = std::make_shared<Blue::Program>();
+	Fold fold{ shared, *prog };
+	if (shared.files.watched(*src)) {
+		Fold::emitter em{ fold };
+		fold.run(em, *src->program);
+		em.flush();
+		prog->code = std::move(em.code);
+	}
+	else fold.untracked = true;
+
+	if (fold.untracked) {
+		// folding would outlive a change nobody is told about, the page is rendered in full every time
+		page->program = std::shared_ptr<const Blue::Program>(src, src->program.get());
+		return page;
+	}
+	if (std::all_of(prog->code.begin(), prog->code.end(), Fold::is_text)) {
+		std::string output{ "\xef\xbb\xbf" };
+		for (const auto &i : prog->code)
+			if (auto text = std::get_if<std::string_view>(&i))
+				output += *text;
+		if (output.size() > 3)	// an empty rendering sends the file as it is
+			page->rendered = shared.files.generated(output, mime_table::html);
+	}
+	page->inputs.cacheable = page->inputs.streamable = true;
+	collect_inputs(*prog, page->inputs);
+	page->program = std::move(prog);
+	shared.pages.emplace(src.get(), page);
+	return page;
+}
+
+/* Everything the page depends on in this request, equal keys render the same */
+file_cache::entry_t Protocol::Page::Variants::find(std::string_view key)
+{
+	if (const auto it = index.find(key); it != index.end()) {
+		lru.splice(lru.begin(), lru, it->second);
+		return it->second->second;
+	}
+	return nullptr;
+}
+
+file_cache::entry_t Protocol::Page::Variants::insert(std::string key, file_cache::entry_t rendering)
+{
+	if (const auto it = index.find(key); it != index.end()) {
+		lru.erase(it->second);
+		index.erase(it);
+	}
+	while (lru.size() >= MAX_PAGE_VARIANTS) {
+		index.erase(lru.back().first);
+		lru.pop_back();
+	}
+	lru.emplace_front(std::move(key), std::move(rendering));
+	index.emplace(lru.front().first, lru.begin());
+	return lru.front().second;
+}
+
+bool Protocol::PageVariant(const Page &page, uint16_t error, std::string &key) const
+{
+	const auto &in = page.inputs;
+	if (!in.cacheable)
+		return false;
+	const auto append = [&key](std::string_view v) {
+		key += std::to_string(v.size());
+		key += ':';
+		key += v;
+	};
+	if (in.error)
+		key += std::to_string(error);
+	key += '|';
+	if (in.session && ss != nullptr) {
+		key += 's';
+		if (in.userlevel)
+			key += std::to_string(ss->userlevel);
+		if (in.username)
+			append(ss->username);
+	}
+	for (const auto &[list, name] : in.fields) {
+		const auto &db = list == Blue::Lookup::get ? info.get : list == Blue::Lookup::post ? info.post : info.cookie;
+		key += '|';
+		if (const auto v = db.find(name); v != db.end())
+			append(v->second);
+	}
+	return true;
+}
+
+void Protocol::RenderPage(const std::shared_ptr<const Page> &page, uint16_t error, rendering &output, bool * request_dependent)
+{
+	Callback::Reusable re(*this, error);
+	Callback call(re, output);
+	output.write("\xef\xbb\xbf"sv);
+	output.hold(page);	// the program's literals are only referenced
+
+	try {
+		if (page->compiled)
+			call.run(page->compiled);
+		else
+			call.run(*page->program);
+	}
+	catch (std::exception &e) {
+		output << "\n"sv << e.what();
+		re.request_dependent = true;
+	}
+	catch (...) {
+		output << "\nSomething went horribly awry ;("sv;
+		re.request_dependent = true;
 	}
-	return {};
+	if (request_dependent)
+		*request_dependent = re.request_dependent;
+}
+
+std::shared_ptr<rendering> Protocol::HandleHTML(std::shared_ptr<const Page> page, uint16_t error, bool * request_dependent)
+{
+	auto output = std::make_shared<rendering>();
+	RenderPage(page, error, *output, request_dependent);
+	if (output->size() > 3)
+		return output;
+	return nullptr;
+}
+
+void Protocol::HandleHTMLChunked(std::shared_ptr<const Page> page, uint16_t error, bool deflate)
+{
+	// the thread's stream, reset rather than set up for every response
+	const auto z = deflate ? &Violet::deflater::local(Violet::encoding::deflate) : nullptr;
+	const auto send = [&](rendering &r, bool last) {
+		if (z) {
+			// compressed straight into the socket's output, behind a size line filled in after,
+			// wide enough for any size_t (a chunk size may have leading zeros)
+			constexpr size_t width = sizeof(size_t) * 2 + 2;
+			auto &out = s.output();
+			const size_t line = out.size();
+			char size[width + 1];
+			out.resize(line + width);
+			for (const auto &v : r.spans())
+				z->write(v.data(), v.size(), out);
+			if (last)
+				z->finish(out);
+			else
+				z->flush(out);
+			if (const size_t n = out.size() - line - width) {
+				const int len = snprintf(size, sizeof(size), "%0*zx\r\n", static_cast<int>(width - 2), n);
+				memcpy(out.data() + line, size, len);
+				s << "\r\n"sv;
+			}
+			else out.resize(line);
+			r.clear();
+		}
+		else if (r.size()) {
+			char size[24];
+			s << std::string_view{ size, static_cast<size_t>(snprintf(size, sizeof(size), "%zx\r\n", r.size())) };
+			// the spans are queued as they are, the chunks go with them
+			const auto taken = r.take();
+			for (const auto &v : taken->spans())
+				s.write_shared(taken, v);
+			s << "\r\n"sv;
+		}
+	};
+
+	rendering output;
+	// whatever is done goes out while the rest is rendered
+	output.drain = [&](rendering &r) {
+		send(r, false);
+		s.update_write();
+	};
+	RenderPage(page, error, output);
+	output.drain = nullptr;
+	send(output, true);
+	s << "0\r\n\r\n"sv;
 }
\ No newline at end of file
@@ -0,0 +1,73 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "mime_types.hpp"
+#include "echo/misc.hpp"
+
+static constexpr default_mime_types defaults;
+
+mime_table::mime_table()
+	: _entries(std::begin(default_mime_types::entries), std::end(default_mime_types::entries)),
+	_slots(defaults.slots.begin(), defaults.slots.end()),
+	_displacements(defaults.displacements.begin(), defaults.displacements.end()), _seed(defaults.seed) {}
+
+void mime_table::set(std::string_view ext, std::string_view type)
+{
+	auto &line = _strings.emplace_back("Content-Type: ");
+	(line += type) += "\r\n";
+	for (auto &e : _entries)
+		if (Violet::__cis_compare(e.ext, ext) == 0) {
+			e.line = line;
+			return;
+		}
+	_entries.push_back({ _strings.emplace_back(ext), line });
+	_dirty = true;
+}
+
+void mime_table::commit()
+{
+	if (!_dirty)
+		return;
+	const size_t n = _entries.size(), buckets = mime_hash::bucket_count(n);
+	std::vector<uint64_t> hashes(n);
+	std::vector<uint32_t> order(n), first(buckets + 1);
+	_slots.resize(mime_hash::table_size(n));
+	_displacements.resize(buckets);
+	for (_seed = 0; !mime_hash::build(_entries.data(), n, _seed, _slots.data(), _slots.size() - 1,
+			_displacements.data(), buckets, hashes.data(), order.data(), first.data()); ++_seed)
+		if (_seed % 64 == 63)	// can't happen with a decent hash, better a bigger table than a stuck startup
+			_slots.resize(_slots.size() * 2);
+	_dirty = false;
+}
+
+const mime_type *mime_table::find(std::string_view ext) const
+{
+	const auto h = mime_hash::hash(ext, _seed);
+	const auto i = _slots[mime_hash::slot(h, _displacements[mime_hash::bucket(h, _displacements.size())], _slots.size() - 1)];
+	return i >= 0 && Violet::__cis_compare(_entries[i].ext, ext) == 0 ? &_entries[i] : nullptr;
+}
+
+const mime_type &mime_table::for_path(std::string_view path) const
+{
+	if (const auto dot = path.find_last_of('.'); dot != std::string_view::npos && path.find('/', dot) == std::string_view::npos)
+		if (const auto m = find(path.substr(dot)))
+			return *m;
+	return plain;
+}
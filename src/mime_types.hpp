@@ -0,0 +1,188 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <array>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* An extension with its header line, the MIME type itself is a slice of it */
+struct mime_type {
+	std::string_view ext, line;	// ".css", "Content-Type: text/css\r\n"
+
+	constexpr std::string_view type() const { return line.substr(14, line.size() - 16); }
+};
+
+#define MIME_TYPE(ext, type) mime_type{ ext, "Content-Type: " type "\r\n" }
+
+namespace mime_hash
+{
+	/* FNV-1a over the case-folded extension */
+	constexpr uint64_t hash(std::string_view ext, uint64_t seed)
+	{
+		uint64_t h = 0xcbf29ce484222325ull ^ (seed * 0x9E3779B97F4A7C15ull);
+		for (const char c : ext) {
+			h ^= static_cast<unsigned char>(c >= 'A' && c <= 'Z' ? c + 32 : c);
+			h *= 0x100000001b3ull;
+		}
+		return h ^ (h >> 32);
+	}
+
+	/* Slot of a key whose bucket got displacement d, the step is odd so the displacements of one key reach every slot */
+	constexpr size_t slot(uint64_t h, uint32_t d, size_t mask)
+	{
+		const uint32_t step = static_cast<uint32_t>((h * 0x9E3779B97F4A7C15ull) >> 32) | 1;
+		return (static_cast<uint32_t>(h) + d * step) & mask;
+	}
+
+	constexpr size_t bucket(uint64_t h, size_t buckets) { return static_cast<size_t>(h >> 32) % buckets; }
+
+	/* Sizes for n keys: a table at most half full and buckets of about four keys */
+	constexpr size_t table_size(size_t n)
+	{
+		size_t size = 1;
+		while (size < n * 2)
+			size <<= 1;
+		return size;
+	}
+
+	constexpr size_t bucket_count(size_t n) { return n / 4 + 1; }
+
+	/*
+		Hash and displace: keys are grouped into small buckets and, the largest bucket first,
+		each bucket gets the first displacement that moves all of its keys into free slots.
+		hashes and order (n) and first (buckets + 1) are scratch space, extensions have to be unique.
+		Returns false if the seed didn't work out, which takes keys hashing alike.
+	*/
+	constexpr bool build(const mime_type *entries, size_t n, uint64_t seed, int32_t *slots, size_t mask,
+			uint32_t *displacements, size_t buckets, uint64_t *hashes, uint32_t *order, uint32_t *first)
+	{
+		for (size_t i = 0; i <= mask; ++i)
+			slots[i] = -1;
+		for (size_t b = 0; b <= buckets; ++b)
+			first[b] = 0;
+		for (size_t i = 0; i < n; ++i) {
+			hashes[i] = hash(entries[i].ext, seed);
+			++first[bucket(hashes[i], buckets) + 1];
+		}
+		// keys sorted by bucket, those of bucket b are order[first[b]] to order[first[b + 1] - 1]
+		uint32_t largest = 0;
+		for (size_t b = 0; b < buckets; ++b) {
+			largest = first[b + 1] > largest ? first[b + 1] : largest;
+			displacements[b] = first[b + 1] += first[b];
+		}
+		for (size_t i = n; i-- > 0; )
+			order[--displacements[bucket(hashes[i], buckets)]] = static_cast<uint32_t>(i);
+
+		for (uint32_t size = largest; size > 0; --size)
+			for (size_t b = 0; b < buckets; ++b) {
+				if (first[b + 1] - first[b] != size)
+					continue;
+				for (uint32_t d = 0;; ++d) {
+					if (d > mask)
+						return false;
+					uint32_t k = first[b];
+					for (; k < first[b + 1]; ++k) {
+						auto &s = slots[slot(hashes[order[k]], d, mask)];
+						if (s >= 0)
+							break;
+						s = static_cast<int32_t>(order[k]);
+					}
+					if (k == first[b + 1]) {
+						displacements[b] = d;
+						break;
+					}
+					while (k-- > first[b])	// undo the keys placed before the collision
+						slots[slot(hashes[order[k]], d, mask)] = -1;
+				}
+			}
+		for (size_t b = 0; b < buckets; ++b)
+			if (first[b + 1] == first[b])
+				displacements[b] = 0;
+		return true;
+	}
+}
+
+/* Built into the binary, content_types.txt only has to list what differs */
+struct default_mime_types {
+	static constexpr mime_type entries[] = {
+		MIME_TYPE(".html", "text/html"), MIME_TYPE(".htm", "text/html"), MIME_TYPE(".css", "text/css"),
+		MIME_TYPE(".js", "application/javascript"), MIME_TYPE(".mjs", "application/javascript"),
+		MIME_TYPE(".json", "application/json"), MIME_TYPE(".map", "application/json"),
+		MIME_TYPE(".webmanifest", "application/manifest+json"), MIME_TYPE(".xml", "application/xml"),
+		MIME_TYPE(".rss", "application/rss+xml"), MIME_TYPE(".atom", "application/atom+xml"),
+		MIME_TYPE(".txt", "text/plain"), MIME_TYPE(".csv", "text/csv"), MIME_TYPE(".md", "text/markdown"),
+		MIME_TYPE(".svg", "image/svg+xml"), MIME_TYPE(".png", "image/png"), MIME_TYPE(".jpg", "image/jpeg"),
+		MIME_TYPE(".jpeg", "image/jpeg"), MIME_TYPE(".gif", "image/gif"), MIME_TYPE(".webp", "image/webp"),
+		MIME_TYPE(".avif", "image/avif"), MIME_TYPE(".ico", "image/x-icon"), MIME_TYPE(".bmp", "image/bmp"),
+		MIME_TYPE(".woff", "font/woff"), MIME_TYPE(".woff2", "font/woff2"), MIME_TYPE(".ttf", "font/ttf"),
+		MIME_TYPE(".otf", "font/otf"), MIME_TYPE(".eot", "application/vnd.ms-fontobject"),
+		MIME_TYPE(".wasm", "application/wasm"), MIME_TYPE(".pdf", "application/pdf"),
+		MIME_TYPE(".zip", "application/zip"), MIME_TYPE(".gz", "application/gzip"), MIME_TYPE(".tar", "application/x-tar"),
+		MIME_TYPE(".7z", "application/x-7z-compressed"), MIME_TYPE(".mp3", "audio/mpeg"), MIME_TYPE(".ogg", "audio/ogg"),
+		MIME_TYPE(".wav", "audio/wav"), MIME_TYPE(".mp4", "video/mp4"), MIME_TYPE(".webm", "video/webm"),
+	};
+	static constexpr size_t count = sizeof(entries) / sizeof(entries[0]),
+		mask = mime_hash::table_size(count) - 1, buckets = mime_hash::bucket_count(count);
+
+	std::array<int32_t, mask + 1> slots{};
+	std::array<uint32_t, buckets> displacements{};
+	uint64_t seed = 0;
+
+	constexpr default_mime_types()
+	{
+		uint64_t hashes[count]{};
+		uint32_t order[count]{}, first[buckets + 1]{};
+		while (!mime_hash::build(entries, count, seed, slots.data(), mask, displacements.data(), buckets, hashes, order, first))
+			++seed;
+	}
+};
+
+/*
+	Extension -> MIME type through a perfect hash, so a lookup is one hash, one displacement and one compare.
+	The defaults are hashed at compile time; entries from content_types.txt replace them in place
+	and only extensions that are new cause a single rebuild at startup, linear in the number of entries.
+	Read-only once the server runs.
+*/
+class mime_table {
+	std::vector<mime_type> _entries;
+	std::vector<int32_t> _slots;
+	std::vector<uint32_t> _displacements;
+	std::deque<std::string> _strings;	// storage of whatever was loaded
+	uint64_t _seed;
+	bool _dirty = false;
+
+public:
+	static constexpr mime_type plain = MIME_TYPE("", "text/plain"), html = MIME_TYPE(".html", "text/html");
+
+	mime_table();
+
+	void set(std::string_view ext, std::string_view type);
+
+	/* Rehashes after set() has added extensions */
+	void commit();
+
+	const mime_type *find(std::string_view ext) const;
+
+	/* By the extension of the last path segment, text/plain if there's nothing better */
+	const mime_type &for_path(std::string_view path) const;
+};
@@ -37,6 +37,7 @@
 #include <unordered_map>
 #include <atomic>
 #include <algorithm>
+#include <charconv>
 #include <exception>
 #include <string>
 #include <future>
@@ -21,8 +21,10 @@
 //#include <strptime.h>
 #include "app_lifetime.h"
 #include "protocol.hpp"
+#include "echo/byte_ranges.hpp"
 
-std::map<std::string, std::string, Violet::functor_less_comparator> Protocol::content_types;
+mime_table Protocol::mime_types;
+compression_policy Protocol::compression;
 
 std::pair<std::mutex, Violet::UniBuffer> Protocol::logging;
 
@@ -41,6 +43,8 @@ void Protocol::Hi::Clear()
 	cookie.clear();
 	//clipboard.clear();
 	file.clear();
+	multipart.reset();
+	form_body.clear();
 
 	table.clear();
 
@@ -48,27 +52,6 @@ void Protocol::Hi::Clear()
 	content_headers.clear();
 }
 
-std::string url_decode(const std::string_view& str) {
-	std::string ret;
-	for(size_t i = 0; i < str.length(); ++i) {
-		unsigned char c = static_cast<unsigned char>(str[i]);
-		if(c == '%' && i + 2 < str.length()) {
-			unsigned char a = static_cast<unsigned char>(str[++i]);
-			unsigned char b = static_cast<unsigned char>(str[++i]);
-			ret.push_back
-				(((('0' <= a && a <= '9')? a - '0' :
-				  ('a' <= a && a <= 'f')? 10 + a - 'a' :
-				  ('A' <= a && a <= 'F')? 10 + a - 'A' : 0) << 4) |
-				 (('0' <= b && b <= '9')? b - '0' :
-				  ('a' <= b && b <= 'f')? 10 + b - 'a' :
-				  ('A' <= b && b <= 'F')? 10 + b - 'A' : 0));
-		} else {
-			ret.push_back(c);
-		}
-	}
-	return ret;
-}
-
 std::string ReadUntilSpace(Violet::UniBuffer &src, const char trim_char)
 {
 	const size_t p1 = src.get_pos();
@@ -121,13 +104,6 @@ std::string ReadUntilSpace(const std::string &src, size_t pos, const char trim_c
 // 	return std::string(data + p1, i - p1 - 1);
 // }
 
-template<class B>
-inline bool EndOfHeader(B&&src)
-{
-	const char * data = src.data() + src.get_pos();
-	return (*data == 0xd && *(data + 1) == 0xa);
-}
-
 template<typename _Pos>
 std::pair<std::string, std::string> __parse_until_post_delimiter(const char * const data, _Pos& pos, const size_t len)
 {
@@ -147,11 +123,8 @@ std::pair<std::string, std::string> __parse_until_post_delimiter(const char * co
 			if (data[i] == '&')
 				break;
 		}
-		p.second.assign(data + pos, i - pos);
-		for (auto &c : p.second)
-			if (c == '+')
-				c = 0x20;
-		p.second = url_decode(p.second);
+		p.second.resize(Violet::url_decoded_size(data + pos, i - pos));
+		Violet::url_decode(data + pos, i - pos, p.second.data(), true);
 		pos = i + 1;
 	}
 	return p;
@@ -188,58 +161,6 @@ std::pair<std::string, std::string> __parse_until_cookie_delimiter(const char *
 	return p;
 }
 
-template<typename _Pos>
-std::pair<std::string, std::string> __parse_until_POST_disposition_delimiter(const char * const data, _Pos &pos, const size_t len)
-{
-	std::pair<std::string, std::string> p;
-	size_t i;
-	for (i = pos; i < len; ++i)
-		if (data[i] < '!' || data[i] > '~' || data[i] == 0x20 || data[i] == ',' || data[i] == ';')
-		{
-			pos = i + 1;
-		}
-		else break;
-	for (i = pos; i < len; ++i)
-		if (data[i] == '=' || data[i] == ';' || data[i] == 0x20)
-		{
-			break;
-		}
-	p.first.assign(data + pos, i - pos);
-	if (data[pos = i] == '=')
-	{
-		if (data[i = ++pos] == '"')
-		{
-			for (i = ++pos; i < len; ++i) {
-				if (data[i] == '"')
-					break;
-			}
-			p.second.assign(data + pos, i - pos);
-			pos = i + 2;
-		}
-		else {
-			for (; i < len; ++i) {
-				if (data[i] < '!' || data[i] > '~' || data[i] == 0x20 || data[i] == ',' || data[i] == ';')
-					break;
-			}
-			p.second.assign(data + pos, i - pos);
-			pos = i + 1;
-		}
-	}
-	return p;
-}
-
-template<class Str, class Map>
-void parse_post_content(const Str & src, Map& dest)
-{
-	size_t pos = 0;
-	const auto len = src.length();
-	do {
-		auto p = __parse_until_POST_disposition_delimiter(src.data(), pos, len);
-		if (!!p.first.size())
-			dest.emplace(std::move(p));
-	} while (pos < len);
-}
-
 size_t Protocol::Hi::BuildFromBuffer(Violet::UniBuffer &&src)
 {
 	unsigned i;
@@ -284,7 +205,8 @@ size_t Protocol::Hi::BuildFromBuffer(Violet::UniBuffer &&src)
 		if (str[i] != '\r')
 			return 0;
 		str[i++] = 0;
-		if ((strcmp(protocol,"HTTP/1.1") == 0 || strcmp(protocol,"HTTP/1.0") == 0) && str[i++] == '\n')
+		http11 = strcmp(protocol,"HTTP/1.1") == 0;
+		if ((http11 || strcmp(protocol,"HTTP/1.0") == 0) && str[i++] == '\n')
 		{
 			raw_headers.clear();
 			do {
@@ -323,102 +245,92 @@ size_t Protocol::Hi::BuildFromBuffer(Violet::UniBuffer &&src)
 size_t Protocol::Hi::ParsePOST(const char * data, const size_t len)
 {
 	size_t pos = 0;
-	if (data[0] == 0xd && data[1] == 0xa)
+	if (len > 1 && data[0] == 0xd && data[1] == 0xa)
 		data += 2;
 
 	if (auto r = raw_headers.find("content-type"); r != raw_headers.end())
 	{
-		const std::string_view type2{ r->second };
-		bool is_multipart = type2.substr(0, strlen("multipart/form-data")) == "multipart/form-data";
-		if (is_multipart) {
-			auto pf = type2.find("boundary=", strlen("multipart/form-data"));
-			if (pf == std::string::npos)
-				return 0;
-			pf += strlen("boundary="); // length of 'boundary='
-			size_t pfe = std::string::npos;
-			for (size_t i = pf, m = type2.length(); i < m; ++i)
-				if (type2[i] < '!' || type2[i] > '~' || type2[i] == ';')
-				{
-					pfe = i - pf;
-					break;
-				}
-			std::string boundary{"--" + static_cast<std::string>(type2.substr(pf, pfe))}, content(data, data + len);
-			pos = boundary.length();
-			while (pos < len)
-			{
-				auto limit = *reinterpret_cast<const uint16_t *>(content.c_str() + pos);
-				if (limit == 0x2d2d)
-					break;
-				if (limit == 0xa0d)
-					pos += 2u;
-				pfe = std::min(content.find(boundary, pos), len);
-				Violet::UniBuffer instance;
-				instance.write_data(content.c_str() + pos, pfe - pos);
-				pos = pfe + boundary.length();
-				pf = 0u;
-				std::map<std::string_view, std::string_view, Violet::cis_functor_less_comparator> headers;
-				do {
-					auto s1 = instance.get_string_current();
-					s1 = s1.substr(0, s1.find(':'));
-					if (s1.size()) {
-						instance.set_pos(instance.get_pos() + s1.size());
-						s1.remove_suffix(1);
-					}
-					auto s2 = instance.get_string_current();
-					s2 = s2.substr(0, s1.find('\n'));
-					instance.set_pos(instance.get_pos() + s2.size());
-					while (s2.size() && !!std::isspace(static_cast<unsigned char>(s2.back())))
-						s1.remove_suffix(1);
-					while (s2.size() && !!std::isspace(static_cast<unsigned char>(s2.front())))
-						s1.remove_prefix(1);
-					headers.emplace(std::make_pair(s1,s2));
-					if (EndOfHeader(instance)) {
-						instance.read<uint16_t>();
-						break;
-					}
-				} while (!instance.is_at_end());
-				
-				if (auto r = headers.find("content-disposition"); r != headers.end())
-				{
-					std::unordered_map<std::string, std::string> disposition;
-					parse_post_content(r->second, disposition);
-					auto name = disposition.find("name");
-					if (name == disposition.end())
-						break;
-					r = headers.find("content-type");
-					auto isv = instance.get_string_current();
-					if (auto rfn = disposition.find("filename"); r != headers.end() || rfn != disposition.end())
-					{
-						_F newfile;
-						newfile.name.assign(name->second);
-						if (rfn != disposition.end())
-							newfile.filename.assign(rfn->second);
-						if (r != headers.end())
-							newfile.mime_type.assign(r->second);
-						newfile.data.assign(isv.data(), isv.data() + isv.size());
-						if (newfile.data.size() > 1 && newfile.data[newfile.data.size() - 2] == '\r' && newfile.data[newfile.data.size() - 1] == '\n')
-							newfile.data.resize(newfile.data.size() - 2);
-						if (newfile.name.size() > 0)
-							file.emplace_back(newfile);
-					}
-					else {
-						isv.remove_suffix(2);
-						if (!!name->second.size())
-							post[name->second] = static_cast<std::string>(isv);
-					}
-				}
-			}
-		}
-		else do {
+		while (pos < len) {
 			auto p = __parse_until_post_delimiter(data, pos, len);
 			if (p.first.size() > 0)
 				post.emplace(std::move(p));
-		} while (pos < len);
+		}
 		return post.size();
 	}
 	else return 0;
 }
 
+bool Protocol::Hi::BeginPOST(const size_t len)
+{
+	using mp = Violet::multipart_parser;
+	multipart.reset();
+	form_body.clear();
+	if (auto r = raw_headers.find("content-type"); r != raw_headers.end())
+		if (const auto boundary = mp::boundary_from_content_type(r->second); !boundary.empty())
+			multipart.emplace(boundary, [this](const mp::part &p) -> mp::sink_t {
+				if (p.name.empty())
+					return {};
+				if (p.filename.size() || p.content_type.size()) {
+					auto &f = file.emplace_back();
+					f.name = p.name;
+					f.filename = p.filename;
+					f.mime_type = p.content_type;
+					f.data.reset(tmpfile());
+					if (!f.data)
+						return {};
+					return f.data.get();
+				}
+				auto &v = post[p.name];
+				v.clear();
+				return &v;
+			}, MAX_FORM_MEMORY);
+	if (multipart)
+		return true;
+	// urlencoded forms are parsed as a whole, so they have to fit in memory
+	if (len > MAX_FORM_MEMORY)
+		return false;
+	form_body.reserve(len);
+	return true;
+}
+
+void Protocol::Hi::FeedPOST(const char * data, const size_t len)
+{
+	if (multipart)
+		multipart->feed(data, len);
+	else
+		form_body.append(data, len);
+}
+
+bool Protocol::Hi::EndPOST()
+{
+	if (multipart) {
+		const bool r = multipart->finish();
+		if (!r)
+			file.clear(); // incomplete uploads are dropped
+		multipart.reset();
+		return r;
+	}
+	ParsePOST(form_body.data(), form_body.size());
+	form_body.clear();
+	form_body.shrink_to_fit();
+	return true;
+}
+
+bool Protocol::Hi::_F::save(const char * dest) const
+{
+	if (!data)
+		return false;
+	FILE * out = fopen(dest, "wb");
+	if (!out)
+		return false;
+	char buffer[16384];
+	rewind(data.get());
+	for (size_t n; (n = fread(buffer, 1, sizeof(buffer), data.get())) > 0;)
+		fwrite(buffer, 1, n, out);
+	fclose(out);
+	return true;
+}
+
 size_t Protocol::Hi::ParseGET(const char *src, size_t offset)
 {
 	const auto len = strlen(src);
@@ -471,39 +383,88 @@ inline unsigned int ReadUnsignedInt(Violet::buffer<T> &src, uint8_t bytes = 2)
 	return i += src.template read<uint8_t>();
 }
 
-//#include "file_cache.hpp"
+/* If-None-Match uses the weak comparison, so W/ prefixes are ignored on both sides */
+static bool etag_listed(std::string_view list, std::string_view tag)
+{
+	if (tag.substr(0, 2) == "W/"sv)
+		tag.remove_prefix(2);
+	while (!list.empty()) {
+		auto item = list.substr(0, list.find(','));
+		list.remove_prefix(std::min(item.size() + 1, list.size()));
+		Violet::remove_prefix_whitespace(item);
+		Violet::remove_suffix_whitespace(item);
+		if (item.substr(0, 2) == "W/"sv)
+			item.remove_prefix(2);
+		if (item == "*"sv || item == tag)
+			return true;
+	}
+	return false;
+}
 
 struct file {
-	bool is_html = false;
-	//std::string_view data;
-	Violet::UniBuffer data;
-	struct stat attrib;
-	
-	//template <class S>
-	static file search(const std::string_view &_sv, const char * _folder)
-	{
-		file _f;
-		std::string fn { _sv };
-		if (_folder != nullptr) {
-			if (_f.data.read_from_file((fn = _folder + fn).c_str())) {
-				::stat(fn.c_str(), &_f.attrib);
-				_f.is_html = false;
-			}
-			else if (_f.data.read_from_file((fn += ".html").c_str())) {
-				_f.is_html = true;
-			}
-			if (!!_f.data.size())
-				return _f;
-			fn.assign(_sv);
-		}
-		if (_f.data.read_from_file((fn = DIRECTORY_SHARED + fn).c_str())) {
-			::stat(fn.c_str(), &_f.attrib);
-			_f.is_html = false;
-		}
-		else if (_f.data.read_from_file((fn += ".html").c_str())) {
-			_f.is_html = true;
-		}
-		return _f;
+	bool is_html = false, error_page = false;
+	bool chunked = false;	// the page is rendered once the head is out, HTTP/1.1 only
+	file_cache::entry_t src;	// static content, shared with the cache
+	file_cache::entry_t encoded;	// precompressed variant of src that is sent instead
+	std::shared_ptr<const Protocol::Page> page;	// src once partially evaluated, templates only
+	std::shared_ptr<const rendering> stream;	// a rendered page, sent span by span instead of body
+	Violet::UniBuffer data;	// anything generated for this response
+	std::string_view head, body, tail;	// what actually goes out, body points into one of the above
+
+	// multipart/byteranges, sent instead of head/body/tail, every slice points into body
+	struct part { std::string head; std::string_view slice; };
+	std::vector<part> parts;
+	std::string closing, multipart_line;
+	mime_type multipart_type;
+
+	inline void own() { body = data.get_string(); }
+
+	inline const file_cache::entry_t &owner() const { return encoded ? encoded : src; }
+
+	/* The body still points into a cached file (whole or a range of it) */
+	inline bool is_shared() const {
+		const auto &o = owner();
+		return o && body.data() >= o->data() && body.data() + body.size() <= o->data() + o->size();
+	}
+
+	inline bool is_whole() const { return src && !encoded && parts.empty() && body.data() == src->data() && body.size() == src->size(); }
+
+	inline size_t length() const {
+		if (stream)
+			return stream->size();
+		if (parts.empty())
+			return head.size() + body.size() + tail.size();
+		size_t n = closing.size();
+		for (const auto &p : parts)
+			n += p.head.size() + p.slice.size();
+		return n;
+	}
+
+	/* A rendering of error.html that didn't depend on the request, still valid */
+	bool use_error_page(Protocol::Shared &shared, uint16_t error = 404) {
+		const auto e = shared.error_pages.find(error);
+		if (e == shared.error_pages.end() || e->second.first != shared.files.generation())
+			return false;
+		src = e->second.second;
+		body = src->get_string();
+		return true;
+	}
+
+	/* Tagged and precompressed like a static file, it goes out the same way every time */
+	void keep_error_page(Protocol::Shared &shared, uint16_t error, size_t generation, std::string_view content) {
+		src = shared.files.generated(content, mime_table::html);
+		body = src->get_string();
+		is_html = false;
+		shared.error_pages.insert_or_assign(error, std::make_pair(generation, src));
+	}
+
+	/* Ranges need the page in one piece */
+	void flatten() {
+		data.clear();
+		for (const auto &v : stream->spans())
+			data << v;
+		own();
+		stream.reset();
 	}
 };
 
@@ -521,6 +482,7 @@ void Protocol::HandleRequest()
 			{
 				received_body = true;
 				body_length = 0;
+				rejected = 0;
 				WriteDateToLog();
 				//printf("> Received %zu bytes [id:%lu]\n%s\n", b.GetLength(), id, b.ToString());
 				if (info.BuildFromBuffer(std::move(b)))
@@ -543,13 +505,36 @@ void Protocol::HandleRequest()
 					}
 					if (info.method == Hi::Method::Post)
 					{
+						bool expect_continue = false;
 						r = info.raw_headers.find("content-length");
 						if (r != info.raw_headers.end() && sscanf(r->second, "%zu", &body_length) == 1) {
-							if (body_length > info.GetRemainingTable()) {
+							// the verdict on the body is reached before a single byte of it is stored
+							std::string_view route = info.fetch;
+							route = route.substr(0, Violet::find_skip_utf8(route, '?'));
+							// header names are lowercase, an expectation is met only if the body is wanted
+							const auto e = info.raw_headers.find("expect");
+							expect_continue = e != info.raw_headers.end() && Violet::__cis_compare(e->second, "100-continue") == 0;
+							if (e != info.raw_headers.end() && !expect_continue)
+								rejected = 417;
+							else if (body_length > shared.body_limit(route) || !info.BeginPOST(body_length))
+								rejected = expect_continue ? 417 : 413;
+						}
+						if (rejected) {
+							body_length = 0;
+							info.keepalive = false;
+						}
+						else if (body_length > 0) {
+							body_received = std::min(body_length, info.GetRemainingTable());
+							info.FeedPOST(info.GetTableAtPos(), body_received);
+							if (body_received < body_length) {
 								received_body = false;
-								body_temp.assign(info.GetTableAtPos(), info.GetTableAtPos() + info.GetRemainingTable());
+								if (expect_continue && body_received == 0) {
+									s << "HTTP/1.1 100 Continue\r\n\r\n"sv;
+									s.update_write();
+								}
 							}
-							else info.ParsePOST(info.GetTableAtPos(), body_length);
+							else if (!info.EndPOST())
+								rejected = 400;
 						}
 					}
 					r = info.raw_headers.find("Host");
@@ -598,14 +583,13 @@ void Protocol::HandleRequest()
 			Violet::UniBuffer b;
 			if (s.read_message(b))
 			{
-				const auto pos = body_temp.size();
-				body_temp.resize(pos + b.length());
-				memcpy(&body_temp[pos], b.data(), b.length());
-				if (body_temp.size() >= body_length) {
-					body_temp.push_back(0);
+				const auto n = std::min(b.length(), body_length - body_received);
+				info.FeedPOST(b.data(), n);
+				body_received += n;
+				if (body_received >= body_length) {
 					received_body = true;
-					info.ParsePOST(body_temp.data(), body_length);
-					body_temp.clear();
+					if (!info.EndPOST())
+						rejected = 400;
 				}
 			}
 			return;
@@ -624,6 +608,7 @@ void Protocol::HandleRequest()
 		file varf;
 		Hi::headers_t::iterator key;
 		bool modified = true, partial = false, created = false;
+		response_head head;
 		uint16_t error = 0;
 		std::string_view filename = info.fetch;
 		const auto get_mark = Violet::find_skip_utf8(filename, '?');
@@ -633,13 +618,12 @@ void Protocol::HandleRequest()
 			filename = filename.substr(0, get_mark);
 		}
 
-		if (info.method == Hi::Method::Post && filename == "/savePycBz") {
+		if (rejected)
+			error = rejected;
+		else if (info.method == Hi::Method::Post && filename == "/savePycBz") {
 			auto fd1 = std::find_if(info.file.begin(), info.file.end(), [](const Hi::_F &sp) { return sp.name == "upfile"; });
-			if (fd1 != info.file.end()) {
-				Violet::UniBuffer ff;
-				ff.write(fd1->data);
-				ff.write_to_file((getenv("HOME") + ('/' + fd1->filename)).c_str());
-			}
+			if (fd1 != info.file.end())
+				fd1->save((getenv("HOME") + ('/' + fd1->filename)).c_str());
 			created = true;
 			error = 201;
 		}
@@ -680,205 +664,290 @@ void Protocol::HandleRequest()
 					auto ef = capf->first.Data.get();
 					shared.captcha_sig.erase(capf);
 					created = true;
-					if (ef.ptr)
+					head.mime = Protocol::mime_types.find(".png"sv);	// built in, never missing
+					if (ef.ptr) {
 						varf.data.read_from_mem(ef.ptr, ef.size);
+						varf.own();
+					}
 				}
 				else error = 404;
 			}
-			else if (varf = file::search(filename, shared.dir_accessible); !varf.is_html) {
-				if (!varf.data.length()) {
-					std::string efn { dir_html };
-					efn += "/error.html";
-					varf.data.read_from_file(efn.c_str());
-					varf.is_html = true;
-					error = 404;
-					if (!varf.data.length())
-						varf.data << "No file found. :(\n"sv;	// one more check just in case there's no error file
+			else if (varf.src = shared.files.search(filename, shared.dir_accessible); varf.src) {
+				varf.is_html = varf.src->is_html;
+				if (varf.is_html && varf.src->is_template)
+					if (varf.page = PreparePage(varf.src); varf.page->rendered) {
+						// renders the same for everyone, from here on it's a static file
+						varf.src = varf.page->rendered;
+						varf.is_html = false;
+					}
+				varf.body = varf.src->get_string();
+			}
+			else if (error = 404; !varf.use_error_page(shared)) {
+				std::string efn { dir_html };
+				efn += "/error.html";
+				varf.is_html = true;
+				varf.error_page = true;
+				if (varf.src = shared.files.load(efn); varf.src && !!varf.src->size())
+					varf.body = varf.src->get_string();
+				else {
+					varf.src.reset();
+					varf.data << "No file found. :(\n"sv;	// one more check just in case there's no error file
+					varf.own();
 				}
-				else if (filename.length() > 5
-						&& filename.substr(filename.length() - 5) == ".html")
-					varf.is_html = true;
 			}
 		}
-		char dt[64];
-		std::unique_ptr<char[]> dtm, s_len, s_range;
-		static const char * dtformat = "%a, %d %b %Y %T GMT";
-		auto now = time(nullptr);
-		tm gmt = *gmtime(&now);
-		strftime(dt, 64, dtformat, &gmt);
+		const char * const dt = Violet::http_date_now();
+		char range[64];
 
-		if (!error && !varf.is_html && !created)
+		// If-None-Match takes precedence, it's checked once the representation is known
+		if (!error && !varf.is_html && !created && varf.src && info.raw_headers.find("if-none-match") == info.raw_headers.end())
 		{
-			gmt = *gmtime(&(varf.attrib.st_ctime));
-			dtm.reset(new char[64]);
-			strftime(dtm.get(), 64, dtformat, &gmt);
 			key = info.raw_headers.find("if-modified-since");
-			if (key != info.raw_headers.end())
-			{
-				tm modt;
-				memset(&modt, 0, sizeof(tm));
-				strptime(key->second, "%a, %d %b %Y %T", &modt);
-				if (difftime(mktime(&modt), mktime(&gmt)) <= 0)
-					modified = false;
-			}
+			if (time_t since; key != info.raw_headers.end() && Violet::parse_http_date(key->second, since) && varf.src->attrib.st_ctime <= since)
+				modified = false;
 		}
-		info.AddHeader("Date", dt);
-		info.AddHeader("Server", VIOLET_CUSTOM_USER_AGENT);
 #ifdef ___KEEP_ALIVE_CONNECTION
 		key = info.raw_headers.find("Connection");
-		if (key == info.raw_headers.end() || Violet::__cis_compare(key->second, "keep-alive") != 0)
-			info.AddHeader("Connection", "close");
-		else
-		{
-			info.AddHeader("Connection", "keep-alive");
-			info.keepalive = true;
-		}
-#else
-		info.AddHeader("Connection", "close");
+		if (rejected != 413 && rejected != 417 && key != info.raw_headers.end() && Violet::__cis_compare(key->second, "keep-alive") == 0)
+			head.keep_alive = info.keepalive = true;
 #endif
-		info.AddHeader("Accept-Ranges", "bytes");
-		if (varf.data.length() > 0 && modified)
+		if (varf.body.length() > 0 && modified)
 		{
 			if (varf.is_html) {
-				if (auto o = HandleHTML(varf.data.get_string(), error); bool(o))
-					varf.data = std::move(*o);
-				info.AddHeader("Content-Type", "text/html");
-			}
-			else {
-				std::string_view ext;
-				if (auto last_period = filename.find_last_of('.'); last_period != std::string::npos)
-					ext = filename.substr(last_period);
-				const auto skey = Protocol::content_types.find(ext);
-				info.AddHeader("Content-Type", skey != Protocol::content_types.end() ? skey->second.c_str() : "text/plain");
+				const auto generation = shared.files.generation();
+				bool dependent = true;
+				// pages without the flag aren't templates and go out as they are
+				if (varf.src && varf.src->is_template && (varf.page || (varf.page = PreparePage(varf.src)))) {
+					// error.html has a cache of its own
+					std::string variant;
+					const bool keep = !varf.error_page && PageVariant(*varf.page, error, variant);
+					if (auto v = keep ? varf.page->variants.find(variant) : nullptr)
+						varf.src = std::move(v);
+					else if (!keep && !varf.error_page && varf.page->inputs.streamable && info.http11 && info.method != Hi::Method::Head
+							&& info.raw_headers.find("range") == info.raw_headers.end()) {
+						varf.chunked = true;
+						varf.body = {};
+					}
+					else if (auto o = HandleHTML(varf.page, error, &dependent)) {
+						if (varf.error_page && !dependent)
+							varf.keep_error_page(shared, error, generation, o->str());
+						else if (keep)	// keys come from the client, a new one isn't worth the best compression
+							varf.src = varf.page->variants.insert(std::move(variant), shared.files.generated(o->str(), mime_table::html, Z_DEFAULT_COMPRESSION));
+						else {
+							varf.stream = std::move(o);
+							varf.body = {};
+						}
+					}
+					if (keep && varf.src != varf.page->source) {
+						// from here on it's a static file, tagged and precompressed
+						varf.body = varf.src->get_string();
+						varf.is_html = false;
+					}
+				}
+				head.mime = &mime_table::html;
 			}
+			else if (varf.src)
+				head.mime = varf.src->mime;
+			else if (!head.mime)
+				head.mime = &Protocol::mime_types.for_path(filename);
 			// RANGE
+			std::vector<std::pair<size_t, size_t>> ranges;
 			key = info.raw_headers.find("range");
-			if (key != info.raw_headers.end())
+			if (varf.stream && key != info.raw_headers.end())
+				varf.flatten();
+			if (key != info.raw_headers.end() && info.method == Hi::Method::Get && Violet::parse_byte_ranges(key->second, varf.body.size(), ranges)
+				&& ranges.size() <= MAX_BYTE_RANGES)
 			{
-				size_t beg = 0, en = 0;
-				const size_t s = varf.data.length();
-				int amt = sscanf(key->second, "bytes=%zu-%zu", &beg, &en);
-				partial = true;
-				if (amt > 0) {
-					s_range.reset(new char[64]);
-					Violet::UniBuffer swap;
-					if (amt == 1)
-						en = s - 1;
-					if (beg >= s || en >= s || beg > en) {
-						error = 416;
-						varf.data.clear();
-					}
-					else {
-						snprintf(s_range.get(), 64, "bytes %zu-%zu/%zu", beg, en, s);
-						info.AddHeader("Content-Range", s_range.get());
-						swap.write_buffer(varf.data, beg, en - beg + 1);
-						varf.data.swap(swap);
-					}
+				// If-Range only lets the ranges through for the exact version the client already has
+				const auto ir = info.raw_headers.find("if-range");
+				partial = ir == info.raw_headers.end() || (varf.src && !varf.is_html && !varf.error_page
+						&& strcmp(ir->second, ir->second[0] == '"' ? varf.src->etag : varf.src->last_modified) == 0);
+				if (!partial)
+					;	// another version, the whole thing goes out
+				else if (ranges.empty()) {
+					error = 416;
+					head.content_range = { range, static_cast<size_t>(snprintf(range, sizeof(range), "bytes */%zu", varf.body.size())) };
+					varf.body = {};
+				}
+				else if (ranges.size() == 1) {
+					const auto [beg, en] = ranges.front();
+					head.content_range = { range, static_cast<size_t>(snprintf(range, sizeof(range), "bytes %zu-%zu/%zu", beg, en, varf.body.size())) };
+					varf.body = varf.body.substr(beg, en - beg + 1);
 				}
 				else {
-					error = 416;
-					varf.data.clear();
+					char boundary[24];
+					Violet::generate_random_string(boundary, sizeof(boundary));
+					const std::string_view b{ boundary, sizeof(boundary) };
+					varf.parts.reserve(ranges.size());
+					for (const auto &[beg, en] : ranges) {
+						auto &p = varf.parts.emplace_back();
+						snprintf(range, sizeof(range), "%zu-%zu/%zu", beg, en, varf.body.size());
+						((((p.head.append(varf.parts.size() > 1 ? "\r\n--"sv : "--"sv) += b) += "\r\nContent-Type: "sv) += head.mime->type())
+								+= "\r\nContent-Range: bytes "sv) += range;
+						p.head += "\r\n\r\n"sv;
+						p.slice = varf.body.substr(beg, en - beg + 1);
+					}
+					((varf.closing = "\r\n--"sv) += b) += "--\r\n"sv;
+					((varf.multipart_line = "Content-Type: multipart/byteranges; boundary="sv) += b) += "\r\n"sv;
+					varf.multipart_type.line = varf.multipart_line;
+					head.mime = &varf.multipart_type;
 				}
 			}
 
 #ifdef USE_PACKET_COMPRESSION
 			// CONTENT ENCODING
+			std::map<std::string, float> encodings;
 			key = info.raw_headers.find("accept-encoding");
 			if (key != info.raw_headers.end())
 			{
-				std::map<std::string, float> encodings;
 				size_t p1 = 0u, p2 = 0u;
 				const size_t len = strlen(key->second);
-				if (len > 0) {
-					auto func1 = [](char c) { return c > 0x20 && c != ';' && c != ','; };
-					while ((p1 = p2) < len) {
-						while (func1(key->second[p2]) && p2 < len)
+				auto func1 = [](char c) { return c > 0x20 && c != ';' && c != ','; };
+				while ((p1 = p2) < len) {
+					while (func1(key->second[p2]) && p2 < len)
+						++p2;
+					if (p1 < p2) {
+						float &enc_val = encodings[std::string{key->second + p1, p2 - p1}];
+						enc_val = 1.f;
+						while (key->second[p2] == 0x20)
 							++p2;
-						if (p1 < p2) {
-							float &enc_val = encodings[std::string{key->second + p1, p2 - p1}];
-							enc_val = 1.f;
-							while (key->second[p2] == 0x20)
-								++p2;
-							if (key->second[p2] == ';')
-							{
-								sscanf(key->second + ++p2, "q=%f", &enc_val);
-								while (key->second[p2] != ',' && p2 < len)
-									++p2;
-								++p2;
-							}
-							else if (key->second[p2] == ',')
-								++p2;
-							while (key->second[p2] == 0x20)
+						if (key->second[p2] == ';')
+						{
+							sscanf(key->second + ++p2, "q=%f", &enc_val);
+							while (key->second[p2] != ',' && p2 < len)
 								++p2;
+							++p2;
 						}
-						else break;
+						else if (key->second[p2] == ',')
+							++p2;
+						while (key->second[p2] == 0x20)
+							++p2;
 					}
-					auto deflate = encodings.find("deflate");
-					if (deflate != encodings.end()) {
-						if (deflate->second > 0.f)
-						{
-							auto swap = Violet::UniBuffer::zlib_compress(varf.data.get_string(), false);
-							if (swap.length() < varf.data.length())
-							{
-								info.AddHeader("Content-Encoding", "deflate");
-								varf.data.swap(swap);
-							}
+					else break;
+				}
+			}
+			const auto accepts = [&encodings](const char * name) {
+				const auto e = encodings.find(name);
+				return e != encodings.end() && e->second > 0.f;
+			};
+			// ranges are served from the identity representation
+			if (partial || (!varf.body.size() && !varf.stream && !varf.chunked))
+				;
+			else if (varf.chunked) {
+				// deflated as it goes, the stream is flushed with every chunk
+				if (Protocol::compression.by_type(head.mime->type())) {
+					head.vary_encoding = true;
+					if (accepts("deflate"))
+						head.content_encoding = "deflate"sv;
+				}
+			}
+			else if (varf.stream) {
+				// deflated span by span, large pages are put together for the compression pool
+				if (Protocol::compression.by_type(head.mime->type())) {
+					head.vary_encoding = true;
+					if (accepts("deflate") && Protocol::compression.worth_it(head.mime->type(), varf.stream->size(), varf.stream->spans().front())) {
+						auto swap = Protocol::compression.compress(varf.stream->spans(), varf.stream->size(), Violet::encoding::deflate);
+						if (swap.length() < varf.stream->size()) {
+							head.content_encoding = "deflate"sv;
+							varf.data.swap(swap);
+							varf.own();
+							varf.stream.reset();
 						}
 					}
 				}
 			}
+			else if (varf.is_shared() && !varf.is_html) {
+				// static files are never compressed here, they either come with a variant or aren't worth it
+				if (varf.is_whole() && varf.src->gzip) {
+					head.vary_encoding = true;
+					if (accepts("gzip")) {
+						head.content_encoding = "gzip"sv;
+						varf.encoded = varf.src->gzip;
+						varf.body = varf.encoded->get_string();
+					}
+					else if (accepts("deflate")) {
+						head.content_encoding = "deflate"sv;
+						varf.encoded = varf.src->gzip;
+						varf.head = { cached_file::zlib_header, sizeof(cached_file::zlib_header) };
+						varf.body = varf.src->deflate_raw;
+						varf.tail = { varf.src->zlib_trailer, sizeof(varf.src->zlib_trailer) };
+					}
+				}
+			}
+			// captchas, archives and tiny bodies aren't worth the cycles
+			else if (Protocol::compression.by_type(head.mime->type())) {
+				head.vary_encoding = true;
+				if (accepts("deflate") && Protocol::compression.worth_it(head.mime->type(), varf.body)) {
+					auto swap = Protocol::compression.compress(varf.body, Violet::encoding::deflate);
+					if (swap.length() < varf.body.length())
+					{
+						head.content_encoding = "deflate"sv;
+						varf.data.swap(swap);
+						varf.own();
+					}
+				}
+			}
 #endif
+			// ENTITY TAG
+			if (const char * etag = varf.encoded ? (varf.head.empty() ? varf.encoded->etag : varf.src->deflate_etag)
+					: varf.src && !varf.is_html && !created ? varf.src->etag : ""; !!*etag) {
+				head.etag = etag;
+				// an error keeps its status and body whatever the client has
+				if (key = info.raw_headers.find("if-none-match"); !error && key != info.raw_headers.end() && etag_listed(key->second, etag))
+					modified = false;
+			}
 			// TRANSFER LENGTH
-			s_len.reset(new char[32]);
-			snprintf(s_len.get(), 32, "%zu", varf.data.length());
-			info.AddHeader("Content-Length", s_len.get());
-			info.AddHeader("Last-Modified", varf.is_html || !bool(dtm) ? dt : dtm.get());
+			if (varf.chunked)
+				head.chunked = true;
+			else if (varf.encoded)
+				head.content_length = varf.head.empty() ? varf.encoded->content_length : varf.src->deflate_length;
+			else if (varf.is_whole())
+				head.content_length = varf.src->content_length;
+			else
+				head.set_length(varf.length());
+			head.last_modified = varf.is_html || !varf.src ? dt : varf.src->last_modified;
 			/* // md5???
 			info.AddHeader("Content-MD5", ...);*/
 		}
 		info.raw_headers.clear();
-		message << "HTTP/1.1 "sv;
-		if (error > 0)
-		{
-			message << std::to_string(static_cast<int>(error)) << char(0x20);
-			switch (error)
-			{
-			case 400:
-				message << "Bad Request"sv;
-				break;
-			case 403:
-				message << "Forbidden"sv;
-				break;
-			case 404:
-				message << "Not Found"sv;
-				break;
-			case 405:
-				message << "Method Not Allowed"sv;
-				break;
-			case 416:
-				message << "Requested Range Not Satisfiable"sv;
-				break;
-			case 501:
-				message << "Not Implemented"sv;
-				break;
-			}
-		}
-		else if (!modified)
-			message << "304 Not Modified"sv;
-		else if (partial)
-			message << "206 Partial Content"sv;
-		else
-			message << "200 OK"sv;
-		message.write_crlf();
+		head.status = error > 0 ? error : !modified ? 304 : partial ? 206 : 200;
+		head.write(message, dt);
 		for (auto &&a : info.content_headers) {
 			message << a.first << ": "sv << a.second << "\r\n"sv;
 		}
 		info.content_headers.clear();
 
 		message.write_crlf();
-		if (varf.data.length() > 0 && modified && info.method != Hi::Method::Head)
-			message << varf.data;
 		s << message;
+		if ((varf.body.length() > 0 || varf.stream || varf.chunked) && modified && info.method != Hi::Method::Head) {
+			const bool shared_body = varf.is_shared();
+			const auto send_body = [&](const std::string_view &v) {
+				if (shared_body)
+					s.write_shared(varf.owner(), v, &varf.owner()->damaged());	// no copy, the cache entry stays alive until it's sent
+				else
+					s << v;
+			};
+			if (varf.chunked)
+				HandleHTMLChunked(varf.page, error, !head.content_encoding.empty());
+			else if (varf.stream) {
+				for (const auto &v : varf.stream->spans())
+					s.write_shared(varf.stream, v);
+			}
+			else if (!varf.parts.empty()) {
+				for (const auto &p : varf.parts) {
+					s << p.head;
+					send_body(p.slice);
+				}
+				s << varf.closing;
+			}
+			else {
+				if (!varf.head.empty())
+					s << varf.head;
+				send_body(varf.body);
+				if (!varf.tail.empty())
+					s << varf.tail;
+			}
+		}
 		response_ready = true;
 		sent = false;
 		last_used = std::chrono::system_clock::now();
@@ -1036,8 +1105,13 @@ void Protocol::CreateSession(std::string_view name, Violet::UniBuffer *loaded_fi
 
 void Protocol::WriteDateToLog()
 {
-	char dt[50];
-	GetTimeGMT(dt, sizeof(dt), "[%j %T]: ");
+	// one strftime per second at most, every request lands here
+	thread_local time_t last = -1;
+	thread_local char dt[50];
+	if (const auto now = time(nullptr); now != last) {
+		last = now;
+		GetTimeGMT(dt, sizeof(dt), "[%j %T]: ");
+	}
 	std::lock_guard<std::mutex> lock(logging.first);
 	logging.second << dt;
 }
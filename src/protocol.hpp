@@ -19,10 +19,18 @@
 
 #pragma once
 #include "echo/tcp.hpp"
+#include "echo/multipart.hpp"
+#include "file_cache.hpp"
+#include "compression.hpp"
+#include "mime_types.hpp"
+#include "response_head.hpp"
+#include "rendering.hpp"
 //#include "error.hpp"
 #include "captcha_image_generator.hpp"
 #include "blog.h"
 
+namespace Blue { enum class Lookup : uint8_t; }
+
 #ifdef _DEBUG
 #define MAX_HEAP_SIZE 16
 #else
@@ -44,6 +52,12 @@
 
 #define ___KEEP_ALIVE_CONNECTION
 
+#define MAX_FORM_MEMORY (1 << 20)	// form fields kept in memory, uploaded files are spooled
+#define MAX_BYTE_RANGES 64	// more than that (after merging) and the whole thing is sent instead
+#define MAX_PREPARED_PAGES 256	// partially evaluated templates, dropped all at once past that
+#define MAX_FOLDED_INCLUDE_DEPTH 16	// deeper includes are left to the request, like a recursive one
+#define MAX_PAGE_VARIANTS 64	// renderings kept per page, the least recently used go first
+
 //#define MONITOR_SOCKETS
 
 
@@ -81,7 +95,7 @@ struct Protocol {
 	struct Hi {
 		using headers_t = std::unordered_map<std::string_view, const char *, std::hash<std::string_view>, Violet::cis_functor_equal_comparator>;
 		headers_t raw_headers, content_headers;
-		bool keepalive = false;
+		bool keepalive = false, http11 = false;
 		const char * fetch = nullptr;//, table;
 
 		enum class Method { Get, Head, Post, Put, Delete, Trace, Options, Error }
@@ -93,7 +107,9 @@ struct Protocol {
 
 		struct _F {
 			std::string name, filename, mime_type;
-			std::vector<char> data;
+			std::unique_ptr<FILE, int(*)(FILE*)> data{ nullptr, &fclose };	// spooled to a temporary file
+
+			bool save(const char * dest) const;
 		};
 
 		std::list<_F> file;
@@ -101,12 +117,20 @@ struct Protocol {
 		
 	protected:
 		Violet::UniBuffer table;
+		std::optional<Violet::multipart_parser> multipart;
+		std::string form_body;
 
 	public:
 		size_t BuildFromBuffer(Violet::UniBuffer &&src);
 
 		size_t ParsePOST(const char * src, const size_t len);
 
+		bool BeginPOST(const size_t len);
+
+		void FeedPOST(const char * src, const size_t len);
+
+		bool EndPOST();
+
 		size_t ParseGET(const char *src, size_t offset = 0);
 
 		size_t ParseCookies(const char * src);
@@ -120,7 +144,7 @@ struct Protocol {
 
 		inline const char * GetTableAtPos() const { return table.data() + table.get_pos(); }
 
-		inline size_t GetRemainingTable() const { return table.length() - table.get_pos(); }
+		inline size_t GetRemainingTable() const { return table.length() - table.get_pos() - 1; }	// without the terminating zero
 
 		template<class S>
 		inline map_t &list(const S & _name) {
@@ -137,8 +161,8 @@ struct Protocol {
 
 	Violet::Socket<std::vector<char>> s;
 	bool received = false, response_ready = false, sent = false, received_body = false;
-	size_t body_length = 0;
-	std::vector<char> body_temp;
+	size_t body_length = 0, body_received = 0;
+	uint16_t rejected = 0;	// status decided before the body was read
 	
 	std::chrono::system_clock::time_point last_used = std::chrono::system_clock::now();
 	
@@ -152,8 +176,48 @@ struct Protocol {
 
 	void HandleRequest();
 
+	/*
+		A template with everything that renders the same for every request already evaluated.
+		Includes and wrappers are folded in, so it's only good for the files.generation() it was made in.
+	*/
+	struct Page {
+		/* What's left of the request that the output can depend on */
+		struct Inputs {
+			bool cacheable = false;	// nothing random, no side effects
+			bool streamable = false;	// adds no headers, the head can go out before the output
+			bool error = false, session = false, userlevel = false, username = false;
+			std::vector<std::pair<Blue::Lookup, std::string_view>> fields;	// list (get, post, cookie) and key
+		};
+
+		file_cache::entry_t source;
+		std::shared_ptr<const Blue::Program> program;	// what's left for each request
+		void (*compiled)(Blue::Runtime &, size_t) = nullptr;	// Blue::Render, run instead when the source was compiled ahead of time
+		file_cache::entry_t rendered;	// the whole output when nothing was left
+		Inputs inputs;
+
+		/* Renderings by PageVariant() key, per thread like the rest of Shared */
+		class Variants {
+			std::list<std::pair<std::string, file_cache::entry_t>> lru;	// most recently used first
+			std::unordered_map<std::string_view, decltype(lru)::iterator> index;	// keys point into lru
+
+		public:
+			file_cache::entry_t find(std::string_view key);
+			file_cache::entry_t insert(std::string key, file_cache::entry_t rendering);
+		};
+		mutable Variants variants;
+	};
+
 private:
-	std::optional<Violet::UniBuffer> HandleHTML(const std::string_view &file, uint16_t error);
+	void RenderPage(const std::shared_ptr<const Page> &page, uint16_t error, rendering &output, bool * request_dependent = nullptr);
+
+	std::shared_ptr<rendering> HandleHTML(std::shared_ptr<const Page> page, uint16_t error, bool * request_dependent = nullptr);
+
+	/* Renders straight into the socket as a chunked body, the head has to be out already */
+	void HandleHTMLChunked(std::shared_ptr<const Page> page, uint16_t error, bool deflate);
+
+	std::shared_ptr<const Page> PreparePage(const file_cache::entry_t &src);
+
+	bool PageVariant(const Page &page, uint16_t error, std::string &key) const;
 
 	void CreateSession(std::string_view name, Violet::UniBuffer *loaded_file);
 
@@ -178,9 +242,20 @@ public:
 		std::vector<Blog> active_blogs;
 		std::list<std::pair<Captcha::Signature, std::chrono::system_clock::time_point>> captcha_sig;
 		std::string_view var_copyright;
-
-		Shared(const char * _access, const char * _accounts, std::string_view _cpr)
-			: dir_accessible(_access), dir_accounts(_accounts), var_copyright{_cpr} {}
+		const size_t max_body;
+		const std::map<std::string, size_t, std::less<>> &body_limits;
+		file_cache files;
+		std::unordered_map<uint16_t, std::pair<size_t, file_cache::entry_t>> error_pages;	// rendered once per files.generation()
+		std::unordered_map<const cached_file *, std::shared_ptr<const Page>> pages;	// keyed by Page::source
+		size_t pages_generation = 0;
+
+		Shared(const char * _access, const char * _accounts, std::string_view _cpr, size_t _max_body, const std::map<std::string, size_t, std::less<>> &_limits)
+			: dir_accessible(_access), dir_accounts(_accounts), var_copyright{_cpr}, max_body(_max_body), body_limits(_limits) {}
+
+		inline size_t body_limit(std::string_view route) const {
+			const auto r = body_limits.find(route);
+			return r != body_limits.end() ? r->second : max_body;
+		}
 	};
 
 	Shared &shared;
@@ -193,7 +268,9 @@ public:
 	
 		////   thread-safe GLOBALS   ////
 
-	static std::map<std::string, std::string, Violet::functor_less_comparator> content_types;
+	static mime_table mime_types;
+
+	static compression_policy compression;
 
 	static const char *dir_html, *dir_log;
 
@@ -0,0 +1,143 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "rendering.hpp"
+#include "echo/utf8.hpp"
+
+namespace
+{
+	// a rendering lives and dies on the thread of its connection
+	std::vector<std::unique_ptr<char[]>> &pool()
+	{
+		thread_local std::vector<std::unique_ptr<char[]>> free_chunks;
+		return free_chunks;
+	}
+}
+
+rendering::~rendering()
+{
+	auto &p = pool();
+	for (auto &c : _chunks)
+		if (p.size() < RENDER_POOL_CHUNKS)
+			p.emplace_back(std::move(c));
+}
+
+void rendering::write(std::string_view text)
+{
+	while (!text.empty()) {
+		if (_used == RENDER_CHUNK_SIZE) {
+			if (text.size() >= RENDER_CHUNK_SIZE) {
+				auto &l = _large.emplace_back(new char[text.size()]);
+				memcpy(l.get(), text.data(), text.size());
+				_spans.emplace_back(l.get(), text.size());
+				_size += text.size();
+				_tail_copied = false;
+				break;
+			}
+			if (auto &p = pool(); !p.empty()) {
+				_chunks.emplace_back(std::move(p.back()));
+				p.pop_back();
+			}
+			else _chunks.emplace_back(new char[RENDER_CHUNK_SIZE]);
+			_used = 0;
+			_tail_copied = false;
+		}
+		const size_t n = std::min(text.size(), static_cast<size_t>(RENDER_CHUNK_SIZE) - _used);
+		char * const dst = _chunks.back().get() + _used;
+		memcpy(dst, text.data(), n);
+		if (_tail_copied)
+			_spans.back() = { _spans.back().data(), _spans.back().size() + n };
+		else
+			_spans.emplace_back(dst, n);
+		_tail_copied = true;
+		_used += n;
+		_size += n;
+		text.remove_prefix(n);
+	}
+	if (drain && _size >= RENDER_DRAIN_SIZE)
+		drain(*this);
+}
+
+void rendering::refer(std::string_view text)
+{
+	if (text.size() < RENDER_REFER_MIN)
+		write(text);
+	else {
+		_spans.emplace_back(text);
+		_size += text.size();
+		_tail_copied = false;
+		if (drain && _size >= RENDER_DRAIN_SIZE)
+			drain(*this);
+	}
+}
+
+void rendering::hold(std::shared_ptr<const void> owner)
+{
+	if (owner && (_holders.empty() || _holders.back() != owner))
+		_holders.emplace_back(std::move(owner));
+}
+
+void rendering::write_utfx(uint32_t x)
+{
+	char seq[6];
+	if (x > 0x7fffffff)
+		x = 0x7fffffff;
+	const auto n = Violet::utf8x::code_length(x);
+	Violet::utf8x::put_switch(seq, n, x);
+	write({ seq, n });
+}
+
+void rendering::clear()
+{
+	auto &p = pool();
+	while (_chunks.size() > 1) {
+		if (p.size() < RENDER_POOL_CHUNKS)
+			p.emplace_back(std::move(_chunks.back()));
+		_chunks.pop_back();
+	}
+	_large.clear();
+	_spans.clear();
+	_used = _chunks.empty() ? RENDER_CHUNK_SIZE : 0;
+	_size = 0;
+	_tail_copied = false;
+}
+
+std::shared_ptr<const rendering> rendering::take()
+{
+	auto r = std::make_shared<rendering>();
+	r->_spans.swap(_spans);
+	r->_chunks.swap(_chunks);
+	r->_large.swap(_large);
+	r->_holders = _holders;	// literals still to come may be referenced from the same files
+	r->_size = _size;
+	_used = RENDER_CHUNK_SIZE;
+	_size = 0;
+	_tail_copied = false;
+	return r;
+}
+
+std::string rendering::str() const
+{
+	std::string s;
+	s.reserve(_size);
+	for (const auto &v : _spans)
+		s += v;
+	return s;
+}
@@ -0,0 +1,83 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define RENDER_CHUNK_SIZE (16 << 10)	// generated output is copied into pooled chunks of this size
+#define RENDER_REFER_MIN 256	// shorter literals are copied, every reference is a write of its own
+#define RENDER_POOL_CHUNKS 64	// free chunks kept per thread
+#define RENDER_DRAIN_SIZE (16 << 10)	// a streamed rendering is drained about this often
+
+/*
+	Template output on its way to the socket, without ever being made contiguous.
+	Literal text of a page is referenced, whatever holds it is kept by hold().
+	Everything generated is copied into chunks that don't move once written,
+	so each span can be queued with Socket::write_shared as it is.
+*/
+class rendering
+{
+	std::vector<std::string_view> _spans;
+	std::vector<std::shared_ptr<const void>> _holders;
+	std::vector<std::unique_ptr<char[]>> _chunks, _large;	// only the former go back to the pool
+	size_t _used = RENDER_CHUNK_SIZE, _size = 0;
+	bool _tail_copied = false;	// the last span ends where the next copy goes
+
+public:
+	/* Called whenever RENDER_DRAIN_SIZE is reached, expected to send the spans and clear() */
+	std::function<void(rendering &)> drain;
+
+	rendering() = default;
+	~rendering();
+	rendering(const rendering &) = delete;
+	rendering &operator=(const rendering &) = delete;
+
+	/* Copied */
+	void write(std::string_view text);
+
+	/* Referenced, text has to outlive one of the holders */
+	void refer(std::string_view text);
+
+	void hold(std::shared_ptr<const void> owner);
+
+	void write_utfx(uint32_t x);
+
+	inline rendering &operator<<(std::string_view text) {
+		write(text);
+		return *this;
+	}
+
+	inline size_t size() const { return _size; }
+
+	inline const std::vector<std::string_view> &spans() const { return _spans; }
+
+	/* A contiguous copy, for what gets cached */
+	std::string str() const;
+
+	/* Drops the spans, keeps the holders and a chunk to write into */
+	void clear();
+
+	/* Moves out what was rendered so far, to be queued while the rest is rendered into new chunks */
+	std::shared_ptr<const rendering> take();
+};
@@ -0,0 +1,119 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "response_head.hpp"
+#include "echo/tcp.hpp"
+#include "echo/http_date.hpp"
+
+using namespace std::string_view_literals;
+
+namespace
+{
+	constexpr uint16_t statuses[] = { 200, 201, 206, 304, 400, 403, 404, 405, 413, 416, 417, 500, 501 };
+	constexpr size_t status_count = sizeof(statuses) / sizeof(statuses[0]);
+
+	struct head_template {
+		std::string text;
+		size_t date_at;
+	};
+
+	head_template compose(uint16_t status, bool keep_alive)
+	{
+		head_template t;
+		((((t.text = "HTTP/1.1 "sv) += std::to_string(status)) += ' ') += response_head::reason(status)) += "\r\nDate: "sv;
+		t.date_at = t.text.size();
+		t.text.append(Violet::http_date_length, ' ');
+		t.text += "\r\nServer: " VIOLET_CUSTOM_USER_AGENT "\r\nAccept-Ranges: bytes\r\n"sv;
+		t.text += keep_alive ? "Connection: keep-alive\r\n"sv : "Connection: close\r\n"sv;
+		return t;
+	}
+
+	// built on first use, never modified afterwards
+	const head_template &find_template(uint16_t status, bool keep_alive)
+	{
+		static const auto templates = [] {
+			std::array<head_template, status_count * 2> t;
+			for (size_t i = 0; i < status_count; ++i) {
+				t[i * 2] = compose(statuses[i], false);
+				t[i * 2 + 1] = compose(statuses[i], true);
+			}
+			return t;
+		}();
+		for (size_t i = 0; i < status_count; ++i)
+			if (statuses[i] == status)
+				return templates[i * 2 + keep_alive];
+		thread_local head_template other;
+		return other = compose(status, keep_alive);
+	}
+
+	inline void field(Violet::UniBuffer &out, std::string_view name, std::string_view value)
+	{
+		if (!value.empty())
+			out << name << value << "\r\n"sv;
+	}
+}
+
+std::string_view response_head::reason(uint16_t status)
+{
+	switch (status)
+	{
+	case 200: return "OK"sv;
+	case 201: return "Created"sv;
+	case 206: return "Partial Content"sv;
+	case 304: return "Not Modified"sv;
+	case 400: return "Bad Request"sv;
+	case 403: return "Forbidden"sv;
+	case 404: return "Not Found"sv;
+	case 405: return "Method Not Allowed"sv;
+	case 413: return "Payload Too Large"sv;
+	case 416: return "Requested Range Not Satisfiable"sv;
+	case 417: return "Expectation Failed"sv;
+	case 500: return "Internal Server Error"sv;
+	case 501: return "Not Implemented"sv;
+	default: return {};
+	}
+}
+
+void response_head::set_length(size_t n)
+{
+	const auto r = std::to_chars(_length, _length + sizeof(_length), n);
+	content_length = { _length, static_cast<size_t>(r.ptr - _length) };
+}
+
+void response_head::write(Violet::UniBuffer &out, const char * date) const
+{
+	const auto &t = find_template(status, keep_alive);
+	const size_t at = out.size();
+	out << std::string_view{ t.text };
+	memcpy(out.data() + at + t.date_at, date, Violet::http_date_length);
+	if (mime)
+		out << mime->line;
+	// anything without a body says so, or a keep-alive client would wait for one
+	if (chunked)
+		out << "Transfer-Encoding: chunked\r\n"sv;
+	else
+		field(out, "Content-Length: "sv, content_length.empty() && status != 304 ? "0"sv : content_length);
+	field(out, "Content-Encoding: "sv, content_encoding);
+	field(out, "Content-Range: "sv, content_range);
+	field(out, "ETag: "sv, etag);
+	field(out, "Last-Modified: "sv, last_modified);
+	if (vary_encoding)
+		out << "Vary: Accept-Encoding\r\n"sv;
+}
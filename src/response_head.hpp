@@ -0,0 +1,48 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include "echo/buffers.hpp"
+#include "mime_types.hpp"
+
+/*
+	The fields every response may carry, serialized behind a template that is built once per
+	status and connection mode: status line, Date, Server, Accept-Ranges and Connection.
+	Only the date is patched into the copied template, the rest are plain appends.
+	Anything rare (Set-Cookie, Allow...) still goes through Hi::AddHeader.
+*/
+struct response_head {
+	uint16_t status = 200;
+	bool keep_alive = false, vary_encoding = false, chunked = false;
+	const mime_type * mime = nullptr;
+	std::string_view content_encoding, content_length, content_range, etag, last_modified;
+
+	/* Content-Length that wasn't precomputed, formatted into the head itself */
+	void set_length(size_t n);
+
+	/* Everything up to, but not including, the extra headers and the blank line */
+	void write(Violet::UniBuffer &out, const char * date) const;
+
+	static std::string_view reason(uint16_t status);
+
+private:
+	char _length[24];
+};
@@ -0,0 +1,91 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "tests.hpp"
+#include "bluescript.hpp"
+
+using namespace std::string_view_literals;
+
+namespace
+{
+	template<class T>
+	const T *at(const Blue::Program &p, size_t i) {
+		return i < p.code.size() ? std::get_if<T>(&p.code[i]) : nullptr;
+	}
+
+	bool literal(const Blue::Program &p, size_t i, std::string_view text) {
+		const auto s = at<std::string_view>(p, i);
+		return s && *s == text;
+	}
+}
+
+TEST(bluescript_template_flag)
+{
+	bool is_template = false;
+	CHECK(Blue::compile_file("\xf0\x9f\x8f\x81<p>page"sv, is_template) && is_template);	// chequered flag
+	CHECK(Blue::compile_file("\n  \xf0\x9f\x8f\x81<p>page"sv, is_template) && is_template);
+	CHECK(Blue::compile_file("<p>page \xf0\x9f\x8f\x81"sv, is_template) && !is_template);
+
+	const auto empty = Blue::compile_file(""sv, is_template);
+	CHECK(!is_template && empty->code.empty());
+}
+
+TEST(bluescript_compiled_once)
+{
+	constexpr auto source =
+		"\xf0\x9f\x8f\x81<p>\xe2\x9d\xa4 echo get q\n"	// heart echo
+		"\xf0\x9f\x8d\x8a greeting == hello \xf0\x9f\x8d\x87 yes \xf0\x9f\x8d\x89 "	// tangerine, grapes, watermelon
+		"\xf0\x9f\x8d\x93\xf0\x9f\x8d\x87 no \xf0\x9f\x8d\x89 tail\n"	// strawberry else
+		"esc \xe2\x9d\x8c\xe2\x9d\xa4 end"sv;	// cross mark escape
+	bool is_template;
+	const auto p = Blue::compile_file(source, is_template);
+	CHECK(p->code.size() == 6);
+
+	// literals aren't copied, they're slices of the source
+	CHECK(literal(*p, 0, "<p>"sv));
+	const auto first = at<std::string_view>(*p, 0);
+	CHECK(first && first->data() >= source.data() && first->data() + first->size() <= source.data() + source.size());
+
+	const auto echo = at<Blue::HeartFunction>(*p, 1);
+	CHECK(echo && echo->key == Blue::Function::Echo && echo->from == Blue::Lookup::get && echo->var == Blue::intern("get[q]"sv));
+
+	const auto branch = at<Blue::Branch>(*p, 2);
+	CHECK(branch && branch->test.name == "greeting"sv && branch->test.op == Blue::Operator::equality);
+	CHECK(branch && branch->then && literal(*branch->then, 0, " yes "sv));
+	CHECK(branch && branch->otherwise && literal(*branch->otherwise, 0, " no "sv));
+
+	CHECK(literal(*p, 3, " tail\nesc "sv));
+	const auto escape = at<Blue::StrategicEscape>(*p, 4);
+	CHECK(escape && escape->val == Blue::Codepoints::RedHeart);
+	CHECK(literal(*p, 5, " end"sv));
+}
+
+TEST(bluescript_unknown_and_broken)
+{
+	bool is_template;
+	// not a function, the marker stays in the text
+	const auto unknown = Blue::compile_file("a \xe2\x99\xa5 notafunction b"sv, is_template);
+	CHECK(unknown->code.size() == 1 && literal(*unknown, 0, "a \xe2\x99\xa5 notafunction b"sv));
+
+	// grapes without their watermelon, rendering fails when it gets there
+	const auto broken = Blue::compile_file("<p>x \xf0\x9f\x8d\x8a broken \xf0\x9f\x8d\x87 never closed"sv, is_template);
+	const auto error = broken->code.empty() ? nullptr : std::get_if<Blue::ParseError>(&broken->code.back());
+	CHECK(error && !error->what.empty());
+}
@@ -0,0 +1,90 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tests.hpp"
+#include "echo/byte_ranges.hpp"
+
+using namespace std::string_view_literals;
+
+namespace
+{
+	using ranges_t = std::vector<std::pair<size_t, size_t>>;
+
+	bool ranges(std::string_view spec, size_t size, const ranges_t &expected)
+	{
+		ranges_t out;
+		return Violet::parse_byte_ranges(spec, size, out) && out == expected;
+	}
+
+	bool ignored(std::string_view spec, size_t size = 1000)
+	{
+		ranges_t out;
+		return !Violet::parse_byte_ranges(spec, size, out);
+	}
+}
+
+TEST(byte_ranges_single)
+{
+	CHECK(ranges("bytes=0-499"sv, 1000, { { 0, 499 } }));
+	CHECK(ranges("bytes=500-"sv, 1000, { { 500, 999 } }));
+	CHECK(ranges("bytes=-200"sv, 1000, { { 800, 999 } }));
+	CHECK(ranges("bytes=-5000"sv, 1000, { { 0, 999 } }));
+	CHECK(ranges("bytes=990-5000"sv, 1000, { { 990, 999 } }));
+	CHECK(ranges("bytes=999-999"sv, 1000, { { 999, 999 } }));
+	CHECK(ranges("BYTES=1-2"sv, 1000, { { 1, 2 } }));
+}
+
+TEST(byte_ranges_unsatisfiable)
+{
+	// a valid header with nothing in it that can be served, that's a 416
+	CHECK(ranges("bytes=-0"sv, 1000, {}));
+	CHECK(ranges("bytes=1000-"sv, 1000, {}));
+	CHECK(ranges("bytes=1000-2000, -0"sv, 1000, {}));
+	CHECK(ranges("bytes=0-"sv, 0, {}));
+	CHECK(ranges("bytes=-10"sv, 0, {}));
+	// unless anything else is satisfiable
+	CHECK(ranges("bytes=-0,5-9"sv, 1000, { { 5, 9 } }));
+}
+
+TEST(byte_ranges_merged)
+{
+	CHECK(ranges("bytes=0-10,5-20,22-30"sv, 1000, { { 0, 20 }, { 22, 30 } }));
+	CHECK(ranges("bytes=0-10,11-20"sv, 1000, { { 0, 20 } }));
+	CHECK(ranges("bytes=500-600, 0-1, 550-"sv, 1000, { { 0, 1 }, { 500, 999 } }));
+	CHECK(ranges("bytes=-100,900-"sv, 1000, { { 900, 999 } }));
+	CHECK(ranges("bytes=5-5,5-5,5-5"sv, 1000, { { 5, 5 } }));
+	CHECK(ranges("bytes= 1-2 ,, 4-5 "sv, 1000, { { 1, 2 }, { 4, 5 } }));
+}
+
+TEST(byte_ranges_malformed)
+{
+	CHECK(ignored(""sv));
+	CHECK(ignored("bytes="sv));
+	CHECK(ignored("bytes=,"sv));
+	CHECK(ignored("items=0-1"sv));
+	CHECK(ignored("bytes = 0-1"sv));
+	CHECK(ignored("bytes=5"sv));
+	CHECK(ignored("bytes=5-1"sv));
+	CHECK(ignored("bytes=a-b"sv));
+	CHECK(ignored("bytes=1-2x"sv));
+	CHECK(ignored("bytes=--1"sv));
+	CHECK(ignored("bytes=-"sv));
+	CHECK(ignored("bytes=0-1,junk"sv));
+	CHECK(ignored("bytes=99999999999999999999999-"sv));
+}
@@ -0,0 +1,96 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tests.hpp"
+#include "compression.hpp"
+#include "echo/parallel_deflate.hpp"
+#include <thread>
+
+namespace
+{
+	// a page the way templates leave it: markup around short substitutions, in many pieces
+	std::vector<std::string_view> render(std::string &page, size_t size)
+	{
+		page.clear();
+		std::vector<size_t> cuts;
+		for (unsigned i = 0; page.size() < size; ++i) {
+			page.append("<li class=\"entry\"><a href=\"/post/");
+			cuts.push_back(page.size());
+			page.append(std::to_string(i * 7919 % 100003));
+			cuts.push_back(page.size());
+			page.append("\">Entry</a></li>\n");
+		}
+		std::vector<std::string_view> spans;
+		size_t last = 0;
+		for (const auto c : cuts) {
+			spans.push_back(std::string_view{ page }.substr(last, c - last));
+			last = c;
+		}
+		spans.push_back(std::string_view{ page }.substr(last));
+		return spans;
+	}
+
+	std::string inflate(std::string_view z, size_t size)
+	{
+		std::string out(size + 1, '\0');
+		uLongf len = out.size();
+		if (uncompress(reinterpret_cast<Bytef *>(&out[0]), &len, reinterpret_cast<const Bytef *>(z.data()), z.size()) != Z_OK)
+			return {};
+		out.resize(len);
+		return out;
+	}
+}
+
+TEST(compression_parallel_threshold)
+{
+	compression_policy p;
+	const bool cores = std::thread::hardware_concurrency() > 1;
+	CHECK(!p.parallel(0));
+	CHECK(!p.parallel(PARALLEL_DEFLATE_THRESHOLD - 1));
+	CHECK(p.parallel(PARALLEL_DEFLATE_THRESHOLD) == cores);
+	p.parallel_threshold = 0;	// disabled
+	CHECK(!p.parallel(64 << 20));
+}
+
+TEST(compression_small_page_by_spans)
+{
+	const compression_policy p;
+	std::string page;
+	const auto spans = render(page, 64 << 10);
+	CHECK(!p.parallel(page.size()));
+	const auto z = p.compress(spans, page.size(), Violet::encoding::deflate);
+	CHECK(z.size() < page.size());
+	CHECK(inflate(z.get_string(), page.size()) == page);
+}
+
+TEST(compression_large_page_on_the_pool)
+{
+	// the blocks end with sync flushes, so the stream tells which path made it
+	const compression_policy p;
+	std::string page;
+	const auto spans = render(page, 3 * PARALLEL_DEFLATE_THRESHOLD);
+	const auto z = p.compress(spans, page.size(), Violet::encoding::deflate);
+	CHECK(inflate(z.get_string(), page.size()) == page);
+	Violet::UniBuffer expected;
+	if (p.parallel(page.size()))
+		Violet::parallel_deflate(page, Violet::encoding::deflate, Z_DEFAULT_COMPRESSION, p.parallel_block, expected);
+	else
+		Violet::deflater::local(Violet::encoding::deflate).write(page.data(), page.size(), expected, Z_FINISH);
+	CHECK(z.get_string() == expected.get_string());
+}
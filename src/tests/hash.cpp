@@ -0,0 +1,55 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tests.hpp"
+#include "echo/hash.hpp"
+#include <string_view>
+
+using namespace std::string_view_literals;
+
+TEST(xxh64_known_values)
+{
+	CHECK(Violet::xxh64(nullptr, 0) == 0xef46db3751d8e999ull);
+	CHECK(Violet::xxh64("a", 1) == 0xd24ec4f1a98c6e5bull);
+	CHECK(Violet::xxh64("abc", 3) == 0x44bc2cf5ad770999ull);
+	constexpr auto spam = "Nobody inspects the spammish repetition"sv;
+	CHECK(Violet::xxh64(spam.data(), spam.size()) == 0xfbcea83c8a378bf1ull);
+}
+
+TEST(xxh64_lengths_and_seed)
+{
+	// every tail (8, 4 and 1 byte steps) and the 32 byte stripes, with and without a seed
+	constexpr struct { size_t len; uint64_t plain, seeded; } expected[] = {
+		{ 4, 0x22eda2cf6af4c124ull, 0xd8d778ded6ee56b4ull },
+		{ 8, 0xc6f1803a5e0b3222ull, 0x81c06e0c87ca2c12ull },
+		{ 31, 0x6ab1c40e29f50073ull, 0x407e1b0246aa4c89ull },
+		{ 32, 0x5a0756fbe9ecd3d1ull, 0x0fdbc75cbf63f5bdull },
+		{ 33, 0xdc50cdc37bb9c183ull, 0x199870762697ae29ull },
+		{ 63, 0x10dd94885c71894aull, 0xe014e7d23af65352ull },
+		{ 64, 0x90083da9cdb9d795ull, 0x93205afc5df112b2ull },
+		{ 100, 0xd248bfc5208b0b16ull, 0x8d818c65ab873d61ull },
+	};
+	unsigned char data[101];
+	for (size_t i = 0; i < 100; ++i)
+		data[i + 1] = static_cast<unsigned char>(i * 7 + 1);
+	for (const auto &e : expected) {
+		CHECK(Violet::xxh64(data + 1, e.len) == e.plain);	// unaligned on purpose
+		CHECK(Violet::xxh64(data + 1, e.len, 0x9e3779b97f4a7c15ull) == e.seeded);
+	}
+}
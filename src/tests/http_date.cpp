@@ -0,0 +1,103 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tests.hpp"
+#include "echo/http_date.hpp"
+#include <cstring>
+
+using namespace std::string_view_literals;
+
+namespace
+{
+	bool parses(std::string_view s, time_t expected)
+	{
+		time_t t = -1;
+		return Violet::parse_http_date(s, t) && t == expected;
+	}
+
+	bool rejects(std::string_view s)
+	{
+		time_t t;
+		return !Violet::parse_http_date(s, t);
+	}
+}
+
+TEST(http_date_format)
+{
+	char out[Violet::http_date_length + 1];
+	CHECK(Violet::format_http_date(784111777, out) == "Sun, 06 Nov 1994 08:49:37 GMT"sv);
+	CHECK(Violet::format_http_date(0, out) == "Thu, 01 Jan 1970 00:00:00 GMT"sv);
+	CHECK(Violet::format_http_date(951782400, out) == "Tue, 29 Feb 2000 00:00:00 GMT"sv);
+	CHECK(Violet::format_http_date(-1, out) == "Wed, 31 Dec 1969 23:59:59 GMT"sv);
+	CHECK(strlen(out) == Violet::http_date_length);
+}
+
+TEST(http_date_matches_libc)
+{
+	char out[Violet::http_date_length + 1], expected[64];
+	for (long long t = 0; t < 4102444800ll; t += 7919 * 86 + 13) {	// to 2100, every weekday and time of day
+		tm parts;
+		const time_t tt = static_cast<time_t>(t);
+		gmtime_r(&tt, &parts);
+		strftime(expected, sizeof expected, "%a, %d %b %Y %H:%M:%S GMT", &parts);
+		CHECK(strcmp(Violet::format_http_date(tt, out), expected) == 0);
+		CHECK(parses(out, tt));
+	}
+}
+
+TEST(http_date_parse)
+{
+	CHECK(parses("Sun, 06 Nov 1994 08:49:37 GMT"sv, 784111777));
+	CHECK(parses("Sunday, 06-Nov-94 08:49:37 GMT"sv, 784111777));
+	CHECK(parses("Sun Nov  6 08:49:37 1994"sv, 784111777));
+	CHECK(parses("Thu, 01 Jan 1970 00:00:00 GMT"sv, 0));
+	CHECK(parses("Tuesday, 29-Feb-00 00:00:00 GMT"sv, 951782400));
+
+	CHECK(rejects(""sv));
+	CHECK(rejects("Sun, 06 Nov 1994 08:49:37 UTC"sv));
+	CHECK(rejects("Sun, 06 Nov 1994 08:49:37 GMT "sv));
+	CHECK(rejects("Sun, 06 Nox 1994 08:49:37 GMT"sv));
+	CHECK(rejects("Sun, 00 Nov 1994 08:49:37 GMT"sv));
+	CHECK(rejects("Sun, 32 Nov 1994 08:49:37 GMT"sv));
+	CHECK(rejects("Sun, 06 Nov 1994 24:00:00 GMT"sv));
+	CHECK(rejects("Sun, 06 Nov 94 08:49:37 GMT"sv));
+	CHECK(rejects("Sun Nov  6 08:49:37 1994 GMT"sv));
+	CHECK(rejects("784111777"sv));
+}
+
+TEST(http_date_truncated)
+{
+	// every prefix of every form, as a client may send them
+	for (const auto full : { "Sun, 06 Nov 1994 08:49:37 GMT"sv, "Sunday, 06-Nov-94 08:49:37 GMT"sv, "Sun Nov  6 08:49:37 1994"sv })
+		for (size_t n = 0; n < full.size(); ++n)
+			CHECK(rejects(full.substr(0, n)));
+
+	CHECK(rejects(","sv));
+	CHECK(rejects("Sun,"sv));
+	CHECK(rejects("Sunday,"sv));
+	CHECK(rejects("Sun,06 Nov 1994 08:49:37 GMT"sv));
+	CHECK(rejects("Sun, "sv));
+	CHECK(rejects("Sun Nov"sv));
+	CHECK(rejects("\xff\xfe, \x01"sv));
+	CHECK(rejects("Sun, 06 Nov 1994 08:49:37 GMT\0"sv));
+	CHECK(rejects("Sun, 6 Nov 1994 08:49:37 GMT"sv));
+	CHECK(rejects("Sun, 06 Nov 1994 8:49:37 GMT"sv));
+	CHECK(rejects("Sun, 06 Nov 1994 08:60:37 GMT"sv));
+	CHECK(rejects("Sun, -6 Nov 1994 08:49:37 GMT"sv));
+}
@@ -0,0 +1,45 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tests.hpp"
+
+static int failures = 0;
+
+std::vector<Tests::test_case> &Tests::registry()
+{
+	static std::vector<test_case> tests;
+	return tests;
+}
+
+void Tests::fail(const char *file, int line, const char *what)
+{
+	fprintf(stderr, "%s:%d: failed %s\n", file, line, what);
+	++failures;
+}
+
+int main()
+{
+	for (const auto &t : Tests::registry()) {
+		const int before = failures;
+		t.run();
+		printf("%-40s %s\n", t.name, failures == before ? "ok" : "FAILED");
+	}
+	printf("%zu tests, %d failed checks\n", Tests::registry().size(), failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tests.hpp"
+#include "mime_types.hpp"
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+
+using namespace std::string_view_literals;
+
+namespace
+{
+	bool finds(const mime_table &m, std::string_view ext, std::string_view type)
+	{
+		const auto e = m.find(ext);
+		return e && e->type() == type && e->line == "Content-Type: " + std::string{ type } + "\r\n";
+	}
+
+	bool is_default(std::string_view ext)
+	{
+		return std::any_of(std::begin(default_mime_types::entries), std::end(default_mime_types::entries),
+				[ext](const mime_type &e) { return e.ext == ext; });
+	}
+}
+
+TEST(mime_defaults)
+{
+	const mime_table m;
+	for (const auto &e : default_mime_types::entries)
+		CHECK(finds(m, e.ext, e.type()));
+	CHECK(finds(m, ".CSS"sv, "text/css"sv));
+	CHECK(finds(m, ".Woff2"sv, "font/woff2"sv));
+	CHECK(m.find(".foo"sv) == nullptr);
+	CHECK(m.find(""sv) == nullptr);
+	CHECK(m.find("."sv) == nullptr);
+	CHECK(m.find(".htmlx"sv) == nullptr);
+	CHECK(m.find(".htm\0"sv) == nullptr);
+}
+
+TEST(mime_for_path)
+{
+	const mime_table m;
+	CHECK(m.for_path("/www/index.html"sv).type() == "text/html"sv);
+	CHECK(m.for_path("/js/app.min.JS"sv).type() == "application/javascript"sv);
+	CHECK(&m.for_path("/www/README"sv) == &mime_table::plain);
+	CHECK(&m.for_path("/www.d/README"sv) == &mime_table::plain);
+	CHECK(&m.for_path("/www/file."sv) == &mime_table::plain);
+	CHECK(&m.for_path(""sv) == &mime_table::plain);
+	CHECK(mime_table::html.type() == "text/html"sv);
+}
+
+TEST(mime_overrides)
+{
+	mime_table m;
+	m.set(".txt"sv, "text/plain; charset=utf-8"sv);
+	CHECK(finds(m, ".txt"sv, "text/plain; charset=utf-8"sv));	// replaced in place, no rebuild needed
+	m.set(".Foo"sv, "application/foo"sv);
+	m.set(".FOO"sv, "application/x-foo"sv);	// same extension in another case
+	m.commit();
+	CHECK(finds(m, ".foo"sv, "application/x-foo"sv));
+	CHECK(finds(m, ".txt"sv, "text/plain; charset=utf-8"sv));
+}
+
+TEST(mime_rebuild_random_extensions)
+{
+	// what a large content_types.txt looks like to the hash: names with nothing in common
+	std::mt19937 random{ 7 };
+	const auto random_extension = [&random] {
+		std::string ext = ".";
+		for (size_t i = 0, n = 1 + random() % 8; i < n; ++i)
+			ext += "abcdefghijklmnopqrstuvwxyz0123456789-+"[random() % 38];
+		return ext;
+	};
+	for (const size_t count : { 150, 200, 600, 5000 }) {
+		mime_table m;
+		std::unordered_map<std::string, std::string> added;
+		while (added.size() < count)
+			if (auto ext = random_extension(); !m.find(ext) && !added.count(ext)) {
+				auto type = "application/x-" + std::to_string(added.size());
+				m.set(ext, type);
+				added.emplace(std::move(ext), std::move(type));
+			}
+		m.commit();
+		for (const auto &[ext, type] : added)
+			CHECK(finds(m, ext, type));
+		for (const auto &e : default_mime_types::entries)
+			CHECK(finds(m, e.ext, e.type()));
+		for (int i = 0; i < 2000; ++i)
+			if (const auto ext = random_extension(); !added.count(ext) && !is_default(ext))
+				CHECK(m.find(ext) == nullptr);
+	}
+}
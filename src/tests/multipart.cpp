@@ -0,0 +1,143 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tests.hpp"
+#include "echo/multipart.hpp"
+#include <map>
+
+using namespace std::string_view_literals;
+
+namespace
+{
+	constexpr auto form =
+		"preamble to be ignored\r\n"
+		"--XyZ\r\n"
+		"Content-Disposition: form-data; name=\"title\"\r\n"
+		"\r\n"
+		"hello\r\n"
+		"--XyZ\r\n"
+		"Content-Disposition: form-data; name=\"upload\"; filename=\"a.txt\"\r\n"
+		"Content-Type: text/plain\r\n"
+		"\r\n"
+		"line\r\n--XyNot the end\r\n"
+		"--XyZ\r\n"
+		"Content-Disposition: form-data; name=\"empty\"\r\n"
+		"\r\n"
+		"\r\n"
+		"--XyZ--\r\n"
+		"epilogue"sv;
+
+	/* Collects every part in memory, keyed by name */
+	struct collector {
+		std::map<std::string, std::string> values;
+		std::map<std::string, Violet::multipart_parser::part> parts;
+		Violet::multipart_parser parser;
+
+		collector(std::string_view boundary = "XyZ"sv, size_t memory_limit = size_t(-1))
+			: parser(boundary, [this](const Violet::multipart_parser::part &p) -> Violet::multipart_parser::sink_t {
+				parts[p.name] = p;
+				return &values[p.name];
+			}, memory_limit) {}
+
+		/* Feeds the input in pieces of at most `step` bytes */
+		collector &feed(std::string_view in, size_t step) {
+			for (size_t i = 0; i < in.size(); i += step)
+				parser.feed(in.data() + i, std::min(step, in.size() - i));
+			return *this;
+		}
+	};
+
+	bool parsed_form(collector &c)
+	{
+		return c.parser.finish() && c.values.size() == 3
+			&& c.values["title"] == "hello" && c.values["upload"] == "line\r\n--XyNot the end" && c.values["empty"].empty()
+			&& c.parts["upload"].filename == "a.txt" && c.parts["upload"].content_type == "text/plain";
+	}
+}
+
+TEST(multipart_whole)
+{
+	collector c;
+	CHECK(parsed_form(c.feed(form, form.size())));
+}
+
+TEST(multipart_split_reads)
+{
+	for (size_t step = 1; step < 48; ++step) {
+		collector c;
+		CHECK(parsed_form(c.feed(form, step)));
+	}
+}
+
+TEST(multipart_boundary_split_everywhere)
+{
+	// two reads, the cut going through every delimiter and header at some point
+	for (size_t cut = 0; cut <= form.size(); ++cut) {
+		collector c;
+		c.parser.feed(form.data(), cut);
+		c.parser.feed(form.data() + cut, form.size() - cut);
+		CHECK(parsed_form(c));
+	}
+}
+
+TEST(multipart_empty_input)
+{
+	collector c;
+	c.parser.feed(nullptr, 0);
+	CHECK(!c.parser.finish());
+	CHECK(c.parser.get_state() == Violet::multipart_parser::State::Preamble);
+	CHECK(c.parts.empty());
+
+	// a body that closes right away has no parts
+	collector closed;
+	closed.feed("--XyZ--\r\n"sv, 1);
+	CHECK(closed.parser.finish());
+	CHECK(closed.parts.empty());
+}
+
+TEST(multipart_truncated)
+{
+	collector c;
+	c.feed(form.substr(0, form.find("--XyZ--")), 7);
+	CHECK(!c.parser.finish());
+	CHECK(c.parser.get_state() != Violet::multipart_parser::State::Error);
+}
+
+TEST(multipart_errors)
+{
+	collector bad_delimiter;
+	bad_delimiter.feed("--XyZ!!\r\n"sv, 3);
+	CHECK(bad_delimiter.parser.get_state() == Violet::multipart_parser::State::Error);
+
+	collector over_limit{ "XyZ"sv, 4 };
+	over_limit.feed(form, 5);
+	CHECK(over_limit.parser.get_state() == Violet::multipart_parser::State::Error);
+
+	CHECK(collector{ ""sv }.parser.get_state() == Violet::multipart_parser::State::Error);
+	CHECK(collector{ std::string(71, 'x') }.parser.get_state() == Violet::multipart_parser::State::Error);
+}
+
+TEST(multipart_boundary_from_content_type)
+{
+	using Violet::multipart_parser;
+	CHECK(multipart_parser::boundary_from_content_type("multipart/form-data; boundary=XyZ"sv) == "XyZ"sv);
+	CHECK(multipart_parser::boundary_from_content_type("Multipart/Form-Data;charset=utf-8; BOUNDARY=\"a b\""sv) == "a b"sv);
+	CHECK(multipart_parser::boundary_from_content_type("multipart/mixed; boundary=XyZ"sv).empty());
+	CHECK(multipart_parser::boundary_from_content_type(""sv).empty());
+}
@@ -0,0 +1,49 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdio>
+#include <vector>
+
+/*
+	Just enough of a test runner for the codecs: every TEST registers itself,
+	a failed CHECK is reported and the test goes on, main() returns the number of failures.
+*/
+namespace Tests
+{
+	struct test_case {
+		const char *name;
+		void (*run)();
+	};
+
+	std::vector<test_case> &registry();
+
+	void fail(const char *file, int line, const char *what);
+
+	struct registrar {
+		registrar(const char *name, void (*run)()) { registry().push_back({ name, run }); }
+	};
+}
+
+#define TEST(name) \
+	static void test_##name(); \
+	static const Tests::registrar registrar_##name{ #name, test_##name }; \
+	static void test_##name()
+
+#define CHECK(cond) ((cond) ? void() : Tests::fail(__FILE__, __LINE__, #cond))
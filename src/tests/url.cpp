@@ -0,0 +1,137 @@
+/*
+    Copyright © 2018 Emilia "Endorfina" Majewska
+
+    This file is part of Violet.
+
+    Violet is free software: you can study it, redistribute it
+    and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    Violet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Violet.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tests.hpp"
+#include "echo/url.hpp"
+#include <cctype>
+#include <cstring>
+
+using namespace std::string_view_literals;
+
+namespace
+{
+	int hex(const char c) {
+		return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+	}
+
+	/* A char at a time, what the vectorized codec has to agree with */
+	std::string reference_decode(std::string_view s, bool form_data)
+	{
+		std::string out;
+		for (size_t i = 0; i < s.size(); ++i)
+			if (form_data && s[i] == '+')
+				out += ' ';
+			else if (s[i] == '%' && i + 2 < s.size() && hex(s[i + 1]) >= 0 && hex(s[i + 2]) >= 0) {
+				out += static_cast<char>(hex(s[i + 1]) << 4 | hex(s[i + 2]));
+				i += 2;
+			}
+			else out += s[i];
+		return out;
+	}
+
+	std::string reference_encode(std::string_view s, bool keep_reserved)
+	{
+		std::string out;
+		for (const char c : s)
+			if (isalnum(static_cast<unsigned char>(c)) || (c && strchr("-_.~", c)) || (c && keep_reserved && strchr("!*'();:@&=+$,/?#[]%", c)))
+				out += c;
+			else {
+				char esc[4];
+				snprintf(esc, sizeof esc, "%%%02x", static_cast<unsigned char>(c));
+				out += esc;
+			}
+		return out;
+	}
+
+	bool decodes(std::string_view s, bool form_data)
+	{
+		std::string in_place{ s };
+		Violet::url_decode_in_place(in_place, form_data);
+		const auto expected = reference_decode(s, form_data);
+		return Violet::url_decode(s, form_data) == expected && in_place == expected
+			&& (form_data || Violet::url_decoded_size(s.data(), s.size()) == expected.size());
+	}
+
+	bool encodes(std::string_view s, bool keep_reserved)
+	{
+		const auto expected = reference_encode(s, keep_reserved);
+		return Violet::url_encode(s, keep_reserved) == expected
+			&& Violet::url_encoded_size(s.data(), s.size(), keep_reserved) == expected.size();
+	}
+}
+
+TEST(url_decode)
+{
+	CHECK(Violet::url_decode("a%20b+c%2Fd"sv) == "a b+c/d");
+	CHECK(Violet::url_decode("a%20b+c"sv, true) == "a b c");
+	CHECK(Violet::url_decode("%e2%9D%A4"sv) == "\xe2\x9d\xa4");
+	// malformed escapes stay as they are
+	CHECK(Violet::url_decode("100%"sv) == "100%");
+	CHECK(Violet::url_decode("%zz%4"sv) == "%zz%4");
+	CHECK(Violet::url_decode("%%41"sv) == "%A");
+	CHECK(Violet::url_decode(""sv).empty());
+	CHECK(Violet::url_decoded_size(nullptr, 0) == 0);
+}
+
+TEST(url_decode_every_offset)
+{
+	// escapes before, across and after every 16 byte block the SSE2 scan looks at
+	for (const auto special : { "%41"sv, "+"sv, "%"sv, "%4"sv, "%g1"sv }) {
+		for (size_t at = 0; at < 40; ++at) {
+			std::string s(48, 'x');
+			s.insert(at, special);
+			CHECK(decodes(s, false));
+			CHECK(decodes(s, true));
+			s.resize(at + special.size());
+			CHECK(decodes(s, false));
+			CHECK(decodes(s, true));
+		}
+	}
+}
+
+TEST(url_encode)
+{
+	CHECK(Violet::url_encode("a b/c?d=e&f"sv) == "a%20b%2fc%3fd%3de%26f");
+	CHECK(Violet::url_encode("a b/c?d=e&f"sv, true) == "a%20b/c?d=e&f");
+	CHECK(Violet::url_encode("-_.~"sv) == "-_.~");
+	CHECK(Violet::url_encode(""sv).empty());
+	std::string out = "x=";
+	CHECK(Violet::url_encode(out, "\xe2\x9d\xa4"sv) == "x=%e2%9d%a4");
+}
+
+TEST(url_encode_every_offset)
+{
+	std::string all;
+	for (int c = 0; c < 256; ++c)
+		all += static_cast<char>(c);
+	CHECK(encodes(all, false));
+	CHECK(encodes(all, true));
+	CHECK(Violet::url_decode(Violet::url_encode(all)) == all);
+
+	// alphanumeric runs ending at every position of the block
+	for (const char special : " /%\x80Zz09"sv)
+		for (size_t at = 0; at < 40; ++at) {
+			std::string s(48, 'q');
+			s[at] = special;
+			CHECK(encodes(s, false));
+			CHECK(encodes(s, true));
+			s.resize(at + 1);
+			CHECK(encodes(s, false));
+		}
+}